@@ -0,0 +1,298 @@
+/*
+   Copyright 2022-2024 mkckr0 <https://github.com/mkckr0>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Benchmarks for the broadcast and pool hot paths, so regressions in
+// broadcast_audio_data, buffer_pool::acquire or the WebSocket fan-out show
+// up before production does. The network benchmarks stand up a real server
+// on loopback and register N UDP peers / M WebSocket sessions through the
+// normal protocol handshake, then drive synthetic quanta through
+// broadcast_audio_data. Reported time is the producer-side cost per
+// quantum; the async sends complete on the net threads. An operator
+// new/delete hook reports allocations per quantum on top.
+
+#include "buffer_pool.hpp"
+#include "network_manager.hpp"
+#include "websocket_manager.hpp"
+#include "audio_manager.hpp"
+#include "constants.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "pre_asio.hpp"
+#include <asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+
+#include <spdlog/spdlog.h>
+
+using namespace audio_share::constants;
+
+namespace {
+
+// ---- allocation counting ---------------------------------------------------
+
+std::atomic<uint64_t> g_alloc_count { 0 };
+
+} // namespace
+
+void* operator new(size_t size)
+{
+    g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc {};
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+constexpr uint16_t BENCH_PORT = 45678;
+constexpr uint32_t CMD_GET_FORMAT = 1;
+constexpr uint32_t CMD_START_PLAY = 2;
+constexpr uint32_t CMD_HEARTBEAT = 3;
+
+// ---- in-process protocol clients -------------------------------------------
+
+// One UDP listener registered through the real TCP handshake. A reader
+// thread answers heartbeats and a drain thread empties the UDP socket so
+// the server never hits a full socket buffer.
+class bench_udp_client {
+public:
+    bench_udp_client(asio::io_context& ioc, uint16_t port)
+        : _tcp(ioc)
+        , _udp(ioc, asio::ip::udp::endpoint(asio::ip::udp::v4(), 0))
+    {
+        _tcp.connect(asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), port));
+
+        uint32_t cmd = CMD_GET_FORMAT;
+        asio::write(_tcp, asio::buffer(&cmd, sizeof(cmd)));
+        uint32_t reply = 0, size = 0;
+        asio::read(_tcp, asio::buffer(&reply, sizeof(reply)));
+        asio::read(_tcp, asio::buffer(&size, sizeof(size)));
+        std::vector<uint8_t> format(size);
+        asio::read(_tcp, asio::buffer(format));
+
+        cmd = CMD_START_PLAY;
+        asio::write(_tcp, asio::buffer(&cmd, sizeof(cmd)));
+        int id = 0;
+        asio::read(_tcp, asio::buffer(&reply, sizeof(reply)));
+        asio::read(_tcp, asio::buffer(&id, sizeof(id)));
+
+        _udp.send_to(asio::buffer(&id, sizeof(id)), asio::ip::udp::endpoint(asio::ip::make_address("127.0.0.1"), port));
+
+        _reader = std::thread([this] {
+            try {
+                while (true) {
+                    uint32_t cmd = 0;
+                    asio::read(_tcp, asio::buffer(&cmd, sizeof(cmd)));
+                    if (cmd == CMD_HEARTBEAT) {
+                        asio::write(_tcp, asio::buffer(&cmd, sizeof(cmd)));
+                    }
+                }
+            } catch (const std::exception&) {
+                // Socket closed, shutting down
+            }
+        });
+        _drainer = std::thread([this] {
+            try {
+                std::vector<uint8_t> buf(MAX_UDP_PAYLOAD_SIZE);
+                asio::ip::udp::endpoint from;
+                while (true) {
+                    _udp.receive_from(asio::buffer(buf), from);
+                }
+            } catch (const std::exception&) {
+                // Socket closed, shutting down
+            }
+        });
+    }
+
+    ~bench_udp_client()
+    {
+        std::error_code ec;
+        _tcp.close(ec);
+        _udp.close(ec);
+        if (_reader.joinable()) {
+            _reader.join();
+        }
+        if (_drainer.joinable()) {
+            _drainer.join();
+        }
+    }
+
+private:
+    asio::ip::tcp::socket _tcp;
+    asio::ip::udp::socket _udp;
+    std::thread _reader;
+    std::thread _drainer;
+};
+
+// One WebSocket session that reads and discards everything it receives.
+class bench_ws_client {
+public:
+    bench_ws_client(asio::io_context& ioc, uint16_t port)
+        : _ws(ioc)
+    {
+        boost::beast::get_lowest_layer(_ws).connect(asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), port));
+        _ws.handshake("127.0.0.1", "/");
+
+        _reader = std::thread([this] {
+            try {
+                boost::beast::flat_buffer buf;
+                while (true) {
+                    _ws.read(buf);
+                    buf.clear();
+                }
+            } catch (const std::exception&) {
+                // Socket closed, shutting down
+            }
+        });
+    }
+
+    ~bench_ws_client()
+    {
+        std::error_code ec;
+        boost::beast::get_lowest_layer(_ws).socket().close(ec);
+        if (_reader.joinable()) {
+            _reader.join();
+        }
+    }
+
+private:
+    boost::beast::websocket::stream<boost::beast::tcp_stream> _ws;
+    std::thread _reader;
+};
+
+// Server plus registered clients, shared by every iteration of one
+// benchmark configuration.
+struct bench_server {
+    bench_server(int udp_peers, int ws_sessions)
+    {
+        spdlog::set_level(spdlog::level::err);
+
+        auto audio = std::make_shared<audio_manager>();
+        audio_manager::capture_config config;
+        _network = std::make_shared<network_manager>(audio);
+
+        _network->start_server("127.0.0.1", BENCH_PORT, config);
+        if (ws_sessions > 0) {
+            // Shares the network manager's io_context, like main() does
+            _websocket = std::make_shared<websocket_manager>(audio);
+            _websocket->start_server(_network->_ioc, "127.0.0.1", BENCH_PORT + 1, config);
+            _network->add_broadcaster(_websocket);
+        }
+        // Only the synthetic quanta should reach the broadcast path, not
+        // whatever the machine happens to be playing
+        audio->stop();
+
+        for (int i = 0; i < udp_peers; ++i) {
+            _udp_clients.push_back(std::make_unique<bench_udp_client>(_client_ioc, BENCH_PORT));
+        }
+        for (int i = 0; i < ws_sessions; ++i) {
+            _ws_clients.push_back(std::make_unique<bench_ws_client>(_client_ioc, BENCH_PORT + 1));
+        }
+    }
+
+    ~bench_server()
+    {
+        _udp_clients.clear();
+        _ws_clients.clear();
+        if (_websocket) {
+            _websocket->stop_server();
+        }
+        _network->stop_server();
+    }
+
+    asio::io_context _client_ioc;
+    std::shared_ptr<network_manager> _network;
+    std::shared_ptr<websocket_manager> _websocket;
+    std::vector<std::unique_ptr<bench_udp_client>> _udp_clients;
+    std::vector<std::unique_ptr<bench_ws_client>> _ws_clients;
+};
+
+// ---- benchmarks ------------------------------------------------------------
+
+void BM_buffer_pool_acquire(benchmark::State& state)
+{
+    static audio_share::buffer_pool pool(CAPTURE_SLAB_SIZE, 8, 32);
+    for (auto _ : state) {
+        auto buffer = pool.acquire();
+        benchmark::DoNotOptimize(buffer);
+    }
+    auto stats = pool.stats();
+    state.counters["hit"] = (double)stats.hit;
+    state.counters["miss"] = (double)stats.miss;
+    state.counters["steal"] = (double)stats.steal;
+}
+BENCHMARK(BM_buffer_pool_acquire)->ThreadRange(1, 4);
+
+// N loopback UDP peers, sweeping quantum size and block_align.
+void BM_broadcast_udp(benchmark::State& state)
+{
+    const int peers = (int)state.range(0);
+    const size_t quantum = (size_t)state.range(1);
+    const int block_align = (int)state.range(2);
+
+    bench_server server(peers, 0);
+    std::vector<char> data(quantum, 0x5a);
+
+    const uint64_t allocs_before = g_alloc_count.load(std::memory_order_relaxed);
+    for (auto _ : state) {
+        server._network->broadcast_audio_data(data.data(), data.size(), block_align);
+    }
+    const uint64_t allocs = g_alloc_count.load(std::memory_order_relaxed) - allocs_before;
+
+    state.counters["allocs_per_quantum"] = benchmark::Counter((double)allocs / (double)state.iterations());
+    state.counters["quanta_per_sec"] = benchmark::Counter((double)state.iterations(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_broadcast_udp)
+    ->ArgsProduct({ { 1, 4, 16, 60 }, { 1920, 3840, 19200 }, { 4, 6, 8 } })
+    ->Unit(benchmark::kNanosecond);
+
+// M WebSocket sessions fed through the additional-broadcaster path.
+void BM_broadcast_websocket(benchmark::State& state)
+{
+    const int sessions = (int)state.range(0);
+    const size_t quantum = (size_t)state.range(1);
+
+    bench_server server(0, sessions);
+    std::vector<char> data(quantum, 0x5a);
+
+    const uint64_t allocs_before = g_alloc_count.load(std::memory_order_relaxed);
+    for (auto _ : state) {
+        server._network->broadcast_audio_data(data.data(), data.size(), 8);
+    }
+    const uint64_t allocs = g_alloc_count.load(std::memory_order_relaxed) - allocs_before;
+
+    state.counters["allocs_per_quantum"] = benchmark::Counter((double)allocs / (double)state.iterations());
+    state.counters["quanta_per_sec"] = benchmark::Counter((double)state.iterations(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_broadcast_websocket)
+    ->ArgsProduct({ { 1, 8, 32 }, { 1920, 19200 } })
+    ->Unit(benchmark::kNanosecond);
+
+} // namespace
+
+BENCHMARK_MAIN();
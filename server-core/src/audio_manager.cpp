@@ -21,7 +21,41 @@ void audio_manager::stop()
     _record_thread.join();
 }
 
-std::string audio_manager::get_format_binary()
+audio_manager::endpoint_list_t audio_manager::get_endpoint_list()
 {
+    // Served from the cache; the platform impl's device-change subscription
+    // (registry listener / IMMNotificationClient) marks it dirty on hotplug,
+    // so the full enumeration roundtrip runs once per device change instead
+    // of once per call
+    std::lock_guard<std::mutex> lock(_endpoint_cache_mutex);
+    if (_endpoint_cache_dirty.load(std::memory_order_acquire)) {
+        refresh_endpoint_cache();
+        _endpoint_cache_dirty.store(false, std::memory_order_release);
+    }
+    return _endpoint_cache;
+}
+
+std::string audio_manager::get_default_endpoint()
+{
+    std::lock_guard<std::mutex> lock(_endpoint_cache_mutex);
+    if (_endpoint_cache_dirty.load(std::memory_order_acquire)) {
+        refresh_endpoint_cache();
+        _endpoint_cache_dirty.store(false, std::memory_order_release);
+    }
+    return _default_endpoint_cache;
+}
+
+std::string audio_manager::get_format_binary(int resample_rate)
+{
+    // Advertise the highest UDP frame version; clients opt in per-session
+    // on cmd_start_play
+    _format->set_protocol_version(2);
+    if (resample_rate > 0) {
+        // Reflect this peer's granted per-connection rate without touching
+        // the shared capture format
+        AudioFormat format = *_format;
+        format.set_resample_rate(resample_rate);
+        return format.SerializeAsString();
+    }
     return _format->SerializeAsString();
 }
\ No newline at end of file
@@ -26,6 +26,7 @@
 #endif
 
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <thread>
 
@@ -71,9 +72,21 @@ public:
 
     struct capture_config {
         std::string endpoint_id;
+        // Additional sources (e.g. a microphone) mixed into the feed. Each
+        // id gets its own capture stream in the same format; the quanta are
+        // combined once per quantum on the capture thread.
+        std::vector<std::string> mix_endpoint_ids;
         encoding_t encoding = encoding_t::encoding_default;
         int channels = 0;
         int sample_rate = 0;
+        int latency = 0;    // target capture latency in frames, 0 keeps the graph default
+        // Windows only: ask for a raw capture stream that bypasses the audio
+        // engine's processing chain (APOs), falling back to the normal shared
+        // stream when the device refuses. Loopback capture cannot leave
+        // shared mode, so this is as close to exclusive as the render path
+        // gets; the achieved device period lands in the stats surface either
+        // way.
+        bool raw_mode = false;
     };
 
     audio_manager();
@@ -83,16 +96,26 @@ public:
     void stop();
     void do_loopback_recording(std::shared_ptr<network_manager> network_manager, const capture_config& config);
 
-    std::string get_format_binary();
+    std::string get_format_binary(int resample_rate = 0);
+
+    const std::shared_ptr<AudioFormat>& get_format() const { return _format; }
 
     endpoint_list_t get_endpoint_list();
 
     std::string get_default_endpoint();
-    
+
 private:
+    // One platform enumeration pass filling both caches; the caller holds
+    // _endpoint_cache_mutex. The impl's device-change subscription marks the
+    // cache dirty on hotplug, so enumeration normally never leaves memory.
+    void refresh_endpoint_cache();
+
     std::thread _record_thread;
     std::atomic_bool _stopped;
     std::shared_ptr<AudioFormat> _format;
+    std::mutex _endpoint_cache_mutex;
+    endpoint_list_t _endpoint_cache;
+    std::string _default_endpoint_cache;
 };
 
 #endif // !BASIC_AUDIO_MANAGER_HPP
\ No newline at end of file
@@ -17,94 +17,216 @@
 #ifndef BUFFER_POOL_HPP
 #define BUFFER_POOL_HPP
 
+#include <atomic>
 #include <cstdint>
 #include <memory>
 #include <mutex>
 #include <vector>
-#include <stack>
 
 namespace audio_share {
 
 /**
- * @brief A thread-safe buffer pool for reducing memory allocation overhead
- *        in high-frequency UDP packet broadcasting.
- * 
- * The pool maintains a stack of reusable buffers. When a buffer is requested,
- * it returns an existing buffer from the pool if available, or creates a new one.
- * Buffers are automatically returned to the pool when the shared_ptr is destroyed.
+ * @brief A buffer pool for reducing memory allocation overhead in
+ *        high-frequency UDP packet broadcasting.
+ *
+ * The fast path is a per-thread magazine cache: acquire and release touch
+ * only thread-local state, no lock and no atomic RMW. When a magazine runs
+ * dry it refills a batch from the shared per-size-class depot, and when it
+ * overflows it flushes a batch back, so the depot mutex is taken once per
+ * batch instead of once per buffer. Buffers are grouped into power-of-two
+ * size classes starting at the base buffer size, and are handed back to the
+ * pool without zeroing - callers treat an acquired buffer as a raw slab.
+ *
+ * Buffers are automatically returned to the pool when the shared_ptr is
+ * destroyed. hit/miss/steal counters expose how well the pool is sized:
+ * a hit is served from the local magazine, a steal refills from the depot,
+ * and a miss falls through to the allocator.
  */
 class buffer_pool {
 public:
     using buffer_t = std::vector<uint8_t>;
     using buffer_ptr = std::shared_ptr<buffer_t>;
 
+    struct stats_t {
+        uint64_t hit = 0;    // Served from the thread-local magazine
+        uint64_t miss = 0;   // Magazine and depot empty, allocated fresh
+        uint64_t steal = 0;  // Magazine refilled from the shared depot
+    };
+
     /**
      * @brief Construct a buffer pool with specified buffer size and initial capacity
-     * @param buffer_size The fixed size of each buffer in the pool
-     * @param initial_capacity Number of buffers to pre-allocate
-     * @param max_pool_size Maximum number of buffers to keep in the pool
+     * @param buffer_size The base size class; larger classes double it up to 8x
+     * @param initial_capacity Number of base-class buffers to pre-allocate
+     * @param max_pool_size Maximum number of buffers kept per size class
      */
     explicit buffer_pool(size_t buffer_size, size_t initial_capacity = 16, size_t max_pool_size = 128)
         : _buffer_size(buffer_size)
         , _max_pool_size(max_pool_size)
     {
-        // Pre-allocate buffers
+        // Pre-allocate base-class buffers into the shared depot
+        std::lock_guard<std::mutex> lock(_depots[0].mutex);
         for (size_t i = 0; i < initial_capacity; ++i) {
-            _pool.push(std::make_unique<buffer_t>(buffer_size));
+            _depots[0].buffers.push_back(std::make_unique<buffer_t>(buffer_size));
         }
     }
 
     /**
-     * @brief Acquire a buffer from the pool
+     * @brief Acquire a base-size-class buffer from the pool
      * @return A shared_ptr to a buffer that will be automatically returned to the pool
      */
     buffer_ptr acquire()
     {
-        std::unique_ptr<buffer_t> buffer;
-        {
-            std::lock_guard<std::mutex> lock(_mutex);
-            if (!_pool.empty()) {
-                buffer = std::move(_pool.top());
-                _pool.pop();
+        return acquire_class(0);
+    }
+
+    /**
+     * @brief Acquire a buffer of at least the requested size
+     * @param size Minimum usable size in bytes
+     * @return A pooled buffer from the smallest fitting size class, or an
+     *         unpooled buffer when the request exceeds the largest class
+     */
+    buffer_ptr acquire(size_t size)
+    {
+        for (size_t cls = 0; cls < NUM_CLASSES; ++cls) {
+            if (size <= class_bytes(cls)) {
+                return acquire_class(cls);
             }
         }
+        // Oversized requests bypass the pool entirely
+        _stats.miss.fetch_add(1, std::memory_order_relaxed);
+        return std::make_shared<buffer_t>(size);
+    }
 
-        if (!buffer) {
-            buffer = std::make_unique<buffer_t>(_buffer_size);
+    /**
+     * @brief Get the current number of buffers in the shared depot
+     *
+     * Buffers parked in thread-local magazines are not counted.
+     */
+    size_t pool_size() const
+    {
+        size_t total = 0;
+        for (auto& depot : _depots) {
+            std::lock_guard<std::mutex> lock(depot.mutex);
+            total += depot.buffers.size();
         }
-
-        // Create a shared_ptr with custom deleter that returns the buffer to the pool
-        return buffer_ptr(buffer.release(), [this](buffer_t* ptr) {
-            return_buffer(std::unique_ptr<buffer_t>(ptr));
-        });
+        return total;
     }
 
     /**
-     * @brief Get the current number of buffers in the pool
+     * @brief Snapshot the hit/miss/steal counters
      */
-    size_t pool_size() const
+    stats_t stats() const
     {
-        std::lock_guard<std::mutex> lock(_mutex);
-        return _pool.size();
+        stats_t s;
+        s.hit = _stats.hit.load(std::memory_order_relaxed);
+        s.miss = _stats.miss.load(std::memory_order_relaxed);
+        s.steal = _stats.steal.load(std::memory_order_relaxed);
+        return s;
     }
 
 private:
-    void return_buffer(std::unique_ptr<buffer_t> buffer)
+    static constexpr size_t NUM_CLASSES = 4;        // base, 2x, 4x, 8x
+    static constexpr size_t MAGAZINE_CAPACITY = 8;  // Buffers cached per thread and class
+
+    size_t class_bytes(size_t cls) const { return _buffer_size << cls; }
+
+    // Per-thread buffer cache. Rebinding to another pool frees the cached
+    // buffers instead of returning them: the previous owner may be gone.
+    struct tl_cache_t {
+        const buffer_pool* owner = nullptr;
+        std::vector<std::unique_ptr<buffer_t>> magazines[NUM_CLASSES];
+    };
+
+    tl_cache_t& local_cache()
+    {
+        thread_local tl_cache_t cache;
+        if (cache.owner != this) {
+            for (auto& magazine : cache.magazines) {
+                magazine.clear();
+            }
+            cache.owner = this;
+        }
+        return cache;
+    }
+
+    buffer_ptr acquire_class(size_t cls)
     {
-        std::lock_guard<std::mutex> lock(_mutex);
-        if (_pool.size() < _max_pool_size) {
-            // Clear and return to pool for reuse
-            buffer->clear();
-            buffer->resize(_buffer_size);
-            _pool.push(std::move(buffer));
+        auto& magazine = local_cache().magazines[cls];
+
+        std::unique_ptr<buffer_t> buffer;
+        if (!magazine.empty()) {
+            buffer = std::move(magazine.back());
+            magazine.pop_back();
+            _stats.hit.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            // Refill half a magazine in one depot visit
+            {
+                auto& depot = _depots[cls];
+                std::lock_guard<std::mutex> lock(depot.mutex);
+                size_t take = std::min(depot.buffers.size(), MAGAZINE_CAPACITY / 2);
+                for (size_t i = 0; i < take; ++i) {
+                    magazine.push_back(std::move(depot.buffers.back()));
+                    depot.buffers.pop_back();
+                }
+            }
+            if (!magazine.empty()) {
+                buffer = std::move(magazine.back());
+                magazine.pop_back();
+                _stats.steal.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                buffer = std::make_unique<buffer_t>(class_bytes(cls));
+                _stats.miss.fetch_add(1, std::memory_order_relaxed);
+            }
         }
-        // If pool is full, buffer will be deleted automatically
+
+        // Create a shared_ptr with custom deleter that returns the buffer to the pool
+        return buffer_ptr(buffer.release(), [this, cls](buffer_t* ptr) {
+            return_buffer(std::unique_ptr<buffer_t>(ptr), cls);
+        });
     }
 
+    void return_buffer(std::unique_ptr<buffer_t> buffer, size_t cls)
+    {
+        // No zeroing on return. Restore the class size only when a caller
+        // resized the vector, so the common path never touches the bytes.
+        if (buffer->size() != class_bytes(cls)) {
+            buffer->resize(class_bytes(cls));
+        }
+
+        auto& magazine = local_cache().magazines[cls];
+        if (magazine.size() < MAGAZINE_CAPACITY) {
+            magazine.push_back(std::move(buffer));
+            return;
+        }
+
+        // Magazine full: flush half of it plus this buffer to the depot
+        auto& depot = _depots[cls];
+        std::lock_guard<std::mutex> lock(depot.mutex);
+        for (size_t i = 0; i < MAGAZINE_CAPACITY / 2 && depot.buffers.size() < _max_pool_size; ++i) {
+            depot.buffers.push_back(std::move(magazine.back()));
+            magazine.pop_back();
+        }
+        if (depot.buffers.size() < _max_pool_size) {
+            depot.buffers.push_back(std::move(buffer));
+        }
+        // Anything over the cap is deleted automatically
+    }
+
+    struct depot_t {
+        mutable std::mutex mutex;
+        std::vector<std::unique_ptr<buffer_t>> buffers;
+    };
+
+    struct atomic_stats_t {
+        std::atomic<uint64_t> hit { 0 };
+        std::atomic<uint64_t> miss { 0 };
+        std::atomic<uint64_t> steal { 0 };
+    };
+
     size_t _buffer_size;
     size_t _max_pool_size;
-    mutable std::mutex _mutex;
-    std::stack<std::unique_ptr<buffer_t>> _pool;
+    depot_t _depots[NUM_CLASSES];
+    atomic_stats_t _stats;
 };
 
 } // namespace audio_share
@@ -0,0 +1,270 @@
+/*
+   Copyright 2022-2024 mkckr0 <https://github.com/mkckr0>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "client_simulator.hpp"
+#include "constants.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "pre_asio.hpp"
+#include <asio.hpp>
+#include <asio/use_awaitable.hpp>
+
+#include <spdlog/spdlog.h>
+
+namespace audio_share {
+
+namespace {
+
+    using default_token = asio::as_tuple_t<asio::use_awaitable_t<>>;
+    using tcp_socket = default_token::as_default_on_t<asio::ip::tcp::socket>;
+    using udp_socket = default_token::as_default_on_t<asio::ip::udp::socket>;
+    using steady_timer = default_token::as_default_on_t<asio::steady_timer>;
+
+    // Client-side view of the wire protocol; must stay in step with
+    // network_manager's cmd_t, capability flags and frame_header_v2
+    enum class cmd_t : uint32_t {
+        cmd_get_format = 1,
+        cmd_start_play = 2,
+        cmd_heartbeat = 3,
+        cmd_heartbeat_stats = 10,
+    };
+    constexpr uint32_t CMD_FLAG_FRAME_V2 = 0x40000000u;
+    constexpr uint32_t CMD_FLAG_COMPACT_FORMAT = 0x04000000u;
+
+#pragma pack(push, 1)
+    struct frame_header_v2 {
+        uint32_t seq;
+        uint64_t capture_us;
+        uint16_t flags;
+        uint16_t fec_k;
+    };
+#pragma pack(pop)
+    constexpr uint16_t FRAME_FLAG_FEC_PARITY = 0x0001;
+
+    // Everything one simulated client records over the run
+    struct client_state_t {
+        bool playing = false;
+        uint64_t frames_received = 0;
+        uint64_t frames_lost = 0;
+        uint32_t last_seq = 0;
+        bool have_seq = false;
+        std::vector<int64_t> latencies_us;
+    };
+
+    int64_t now_us()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // One simulated client: TCP handshake, UDP registration, then stream
+    // reception with per-frame latency and loss accounting until stopped
+    asio::awaitable<void> run_client(asio::ip::tcp::endpoint server, client_state_t& state, bool measure, std::chrono::seconds duration)
+    {
+        auto executor = co_await asio::this_coro::executor;
+        // Sockets are shared with the detached helper coroutines below, so
+        // whichever coroutine finishes last keeps them alive
+        auto tcp = std::make_shared<tcp_socket>(executor);
+        if (auto [ec] = co_await tcp->async_connect(server); ec) {
+            spdlog::error("simulate: connect failed: {}", ec.message());
+            co_return;
+        }
+        tcp->set_option(asio::ip::tcp::no_delay(true));
+
+        // cmd_get_format: reply is cmd, size, blob. Simulated clients ask
+        // for the compact reply, so every run exercises the fixed-layout
+        // path embedded clients use.
+        {
+            uint32_t cmd = (uint32_t)cmd_t::cmd_get_format | CMD_FLAG_COMPACT_FORMAT;
+            if (auto [ec, _] = co_await asio::async_write(*tcp, asio::buffer(&cmd, sizeof(cmd))); ec) {
+                co_return;
+            }
+            uint32_t reply_cmd = 0, size = 0;
+            std::array<asio::mutable_buffer, 2> buffers = {
+                asio::buffer(&reply_cmd, sizeof(reply_cmd)),
+                asio::buffer(&size, sizeof(size)),
+            };
+            if (auto [ec, _] = co_await asio::async_read(*tcp, buffers); ec) {
+                co_return;
+            }
+            std::vector<char> format(size);
+            if (auto [ec, _] = co_await asio::async_read(*tcp, asio::buffer(format)); ec) {
+                co_return;
+            }
+        }
+
+        // cmd_start_play with v2 frames, so every segment carries capture_us
+        int id = 0;
+        {
+            uint32_t cmd = (uint32_t)cmd_t::cmd_start_play | CMD_FLAG_FRAME_V2;
+            if (auto [ec, _] = co_await asio::async_write(*tcp, asio::buffer(&cmd, sizeof(cmd))); ec) {
+                co_return;
+            }
+            uint32_t reply_cmd = 0;
+            std::array<asio::mutable_buffer, 2> buffers = {
+                asio::buffer(&reply_cmd, sizeof(reply_cmd)),
+                asio::buffer(&id, sizeof(id)),
+            };
+            if (auto [ec, _] = co_await asio::async_read(*tcp, buffers); ec) {
+                co_return;
+            }
+            if (!(reply_cmd & CMD_FLAG_FRAME_V2)) {
+                spdlog::error("simulate: server refused v2 frames, cannot measure latency");
+                co_return;
+            }
+        }
+        state.playing = true;
+
+        // Register the UDP endpoint the stream should go to
+        auto udp = std::make_shared<udp_socket>(executor);
+        asio::ip::udp::endpoint udp_server(server.address(), server.port());
+        udp->open(udp_server.protocol());
+        co_await udp->async_send_to(asio::buffer(&id, sizeof(id)), udp_server);
+
+        // Drain server-side heartbeats so the TCP window never fills
+        asio::co_spawn(executor, [tcp]() -> asio::awaitable<void> {
+            uint32_t word = 0;
+            while (true) {
+                if (auto [ec, _] = co_await asio::async_read(*tcp, asio::buffer(&word, sizeof(word))); ec) {
+                    co_return;
+                }
+            }
+        }, asio::detached);
+
+        // Tick our own heartbeat at half the server's timeout, reporting the
+        // receive high-water mark and loss count so a simulated run also
+        // exercises the adaptive quality controller
+        asio::co_spawn(executor, [tcp, &state]() -> asio::awaitable<void> {
+            steady_timer timer(tcp->get_executor());
+            while (true) {
+                timer.expires_after(constants::HEARTBEAT_TIMEOUT / 2);
+                if (auto [ec] = co_await timer.async_wait(); ec) {
+                    co_return;
+                }
+                uint32_t words[3] = { (uint32_t)cmd_t::cmd_heartbeat_stats, state.last_seq, (uint32_t)state.frames_lost };
+                if (auto [ec, _] = co_await asio::async_write(*tcp, asio::buffer(words)); ec) {
+                    co_return;
+                }
+            }
+        }, asio::detached);
+
+        // A parallel deadline closes both sockets, cancelling the receive
+        // loop so the whole client unwinds cleanly
+        asio::co_spawn(executor, [tcp, udp, duration]() -> asio::awaitable<void> {
+            steady_timer deadline(tcp->get_executor());
+            deadline.expires_after(duration);
+            co_await deadline.async_wait();
+            std::error_code ignored;
+            udp->close(ignored);
+            tcp->close(ignored);
+        }, asio::detached);
+
+        std::vector<char> datagram(65536);
+        asio::ip::udp::endpoint from;
+        while (true) {
+            auto [ec, n] = co_await udp->async_receive_from(asio::buffer(datagram), from);
+            if (ec) {
+                break;  // cancelled by the deadline or socket error
+            }
+            if (n < sizeof(frame_header_v2)) {
+                continue;
+            }
+            frame_header_v2 header {};
+            std::memcpy(&header, datagram.data(), sizeof(header));
+            if (header.flags & FRAME_FLAG_FEC_PARITY) {
+                continue;  // parity packets are not data frames
+            }
+            ++state.frames_received;
+            if (state.have_seq && header.seq != state.last_seq + 1 && header.seq > state.last_seq) {
+                state.frames_lost += header.seq - state.last_seq - 1;
+            }
+            state.last_seq = header.seq;
+            state.have_seq = true;
+            if (measure) {
+                state.latencies_us.push_back(now_us() - (int64_t)header.capture_us);
+            }
+        }
+    }
+
+    int64_t percentile(std::vector<int64_t>& sorted, double p)
+    {
+        if (sorted.empty()) {
+            return 0;
+        }
+        size_t idx = (size_t)(p * (sorted.size() - 1));
+        return sorted[idx];
+    }
+
+} // namespace
+
+bool client_simulator::run(const config_t& config)
+{
+    asio::io_context ioc;
+    std::vector<client_state_t> states(config.clients);
+    asio::ip::tcp::endpoint server { asio::ip::make_address(config.host), config.port };
+
+    spdlog::info("simulate: {} clients against {} for {}s{}", config.clients, server,
+        config.duration_seconds, config.measure_latency ? " (measuring latency)" : "");
+
+    for (int i = 0; i < config.clients; ++i) {
+        asio::co_spawn(ioc, run_client(server, states[i], config.measure_latency,
+            std::chrono::seconds(config.duration_seconds)), asio::detached);
+    }
+    ioc.run();
+
+    // Per-client report plus an aggregate over every received frame
+    bool all_played = true;
+    std::vector<int64_t> all_latencies;
+    uint64_t total_received = 0, total_lost = 0;
+    for (int i = 0; i < config.clients; ++i) {
+        auto& state = states[i];
+        all_played = all_played && state.playing;
+        total_received += state.frames_received;
+        total_lost += state.frames_lost;
+        if (config.measure_latency) {
+            std::sort(state.latencies_us.begin(), state.latencies_us.end());
+            all_latencies.insert(all_latencies.end(), state.latencies_us.begin(), state.latencies_us.end());
+            fmt::println("client {:3} frames:{:8} lost:{:6} p50:{:6}us p90:{:6}us p99:{:6}us max:{:6}us",
+                i, state.frames_received, state.frames_lost,
+                percentile(state.latencies_us, 0.50), percentile(state.latencies_us, 0.90),
+                percentile(state.latencies_us, 0.99), state.latencies_us.empty() ? 0 : state.latencies_us.back());
+        } else {
+            fmt::println("client {:3} frames:{:8} lost:{:6}", i, state.frames_received, state.frames_lost);
+        }
+    }
+
+    const double loss_pct = total_received + total_lost
+        ? 100.0 * (double)total_lost / (double)(total_received + total_lost)
+        : 0.0;
+    if (config.measure_latency) {
+        std::sort(all_latencies.begin(), all_latencies.end());
+        fmt::println("aggregate  frames:{:8} lost:{:6} ({:.3f}%) p50:{:6}us p90:{:6}us p99:{:6}us max:{:6}us",
+            total_received, total_lost, loss_pct,
+            percentile(all_latencies, 0.50), percentile(all_latencies, 0.90),
+            percentile(all_latencies, 0.99), all_latencies.empty() ? 0 : all_latencies.back());
+    } else {
+        fmt::println("aggregate  frames:{:8} lost:{:6} ({:.3f}%)", total_received, total_lost, loss_pct);
+    }
+
+    return all_played;
+}
+
+} // namespace audio_share
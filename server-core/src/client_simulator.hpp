@@ -0,0 +1,58 @@
+/*
+   Copyright 2022-2024 mkckr0 <https://github.com/mkckr0>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef CLIENT_SIMULATOR_HPP
+#define CLIENT_SIMULATOR_HPP
+
+#include <cstdint>
+#include <string>
+
+namespace audio_share {
+
+/**
+ * @brief In-process load generator and latency harness.
+ *
+ * Spins up N clients speaking the real wire protocol (TCP control commands
+ * plus UDP registration and stream reception) against a running server, so
+ * a 100-client incident reproduces on one machine. Clients negotiate v2
+ * frames and, when measuring, derive capture->receive latency from the
+ * capture_us carried in every frame header - the server and the simulated
+ * clients share one steady clock in-process, so no marker injection or
+ * clock sync is needed. Sequence gaps give per-client loss.
+ *
+ * run() blocks for the configured duration, then prints per-client latency
+ * percentiles and loss plus an aggregate line, and returns.
+ */
+class client_simulator {
+public:
+    struct config_t {
+        std::string host;
+        uint16_t port = 0;
+        int clients = 1;
+        int duration_seconds = 10;
+        bool measure_latency = false;
+    };
+
+    /**
+     * @brief Run the simulation to completion
+     * @return true when every client connected and played, false otherwise
+     */
+    static bool run(const config_t& config);
+};
+
+} // namespace audio_share
+
+#endif // !CLIENT_SIMULATOR_HPP
@@ -37,10 +37,65 @@ namespace constants {
     // Use the smaller payload size (IPv6) to ensure compatibility with both protocols
     constexpr int MAX_UDP_PAYLOAD_SIZE = DEFAULT_MTU - IPV6_HEADER_SIZE - UDP_HEADER_SIZE;
     
+    // Capture ring between the realtime capture callback and the net thread.
+    // Sized to hold well over a second of 48 kHz f32 stereo audio.
+    constexpr size_t CAPTURE_RING_CAPACITY = 1 << 20;
+
+    // Pooled slab that holds one whole capture quantum; segments are views
+    // into it. Slabs grow on demand if a quantum ever exceeds this.
+    constexpr size_t CAPTURE_SLAB_SIZE = 64 * 1024;
+
+    // Shared-memory ring offered to same-host peers; sized like the capture
+    // ring so a briefly stalled local consumer has over a second of slack
+    constexpr size_t SHM_RING_CAPACITY = 1 << 20;
+
+    // Flight recorder ring: a few seconds of 48 kHz f32 stereo plus the
+    // per-quantum descriptor index mapped from a temp file
+    constexpr size_t RECORDER_RING_CAPACITY = 4 << 20;
+
+    // TTL for the optional multicast streaming mode; enough for a routed
+    // campus LAN without leaking further
+    constexpr int MULTICAST_TTL = 8;
+
+    // Silence gate: all-zero quanta are broadcast for the hangover (so
+    // short gaps stay gapless), then suppressed down to one-frame keepalive
+    // quanta at the keepalive interval
+    constexpr int DEFAULT_SILENCE_HANGOVER_MS = 300;
+    constexpr auto SILENCE_KEEPALIVE_INTERVAL = std::chrono::milliseconds(500);
+
     // Heartbeat timing
     constexpr auto HEARTBEAT_INTERVAL = std::chrono::seconds(3);
     constexpr auto HEARTBEAT_TIMEOUT = std::chrono::seconds(5);
+
+    // How long a disconnected peer's negotiated state stays resumable via
+    // its session token; long enough to ride out a Wi-Fi roam or a mobile
+    // handover, short enough that stale state never piles up
+    constexpr auto RESUME_CACHE_TTL = std::chrono::seconds(30);
     
+    // TCP streaming fallback for peers whose UDP registration never
+    // arrives (inbound-unrelated UDP firewalled): how long to wait for the
+    // registration datagram, and how many quanta a peer's outbox may hold
+    // before the oldest is dropped
+    constexpr auto TCP_FALLBACK_TIMEOUT = std::chrono::seconds(3);
+    constexpr int MAX_TCP_OUTBOX_QUANTA = 32;
+
+    // Adaptive quality controller, driven by per-client loss reports on
+    // cmd_heartbeat_stats: loss at or above the threshold in one report
+    // window steps that peer's FEC protection up; this many loss-free
+    // reports in a row step it back toward what the client asked for
+    constexpr int QUALITY_LOSS_DEGRADE_PERMILLE = 20;
+    constexpr int QUALITY_CLEAN_INTERVALS = 10;
+
+    // Cap on async UDP sends outstanding at once (the slow path entered
+    // when the socket buffer is full). Beyond this, segments are dropped
+    // instead of piling completion handlers into the io_context.
+    constexpr int MAX_UDP_INFLIGHT_SEGMENTS = 1024;
+
+    // Cap on paced quanta waiting for a timed release. When the pacer
+    // falls this far behind, further batches are sent immediately so
+    // pacing can never grow latency past a couple of quanta.
+    constexpr int MAX_PACE_PENDING_BATCHES = 4;
+
     // Protocol limits
     constexpr int MAX_AUDIO_FORMAT_SIZE = 1024;  // Maximum size of AudioFormat message
     constexpr int MAX_CLIENTS = 100;  // Maximum number of concurrent clients
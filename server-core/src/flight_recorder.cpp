@@ -0,0 +1,250 @@
+/*
+   Copyright 2022-2024 mkckr0 <https://github.com/mkckr0>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "flight_recorder.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#ifdef linux
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WINDOWS
+#include <Windows.h>
+#include "win32/audio_manager_impl.hpp"  // str_win_err
+#endif
+
+namespace audio_share {
+
+namespace {
+
+    std::string recorder_dir()
+    {
+#ifdef linux
+        const char* tmp = getenv("TMPDIR");
+        return tmp && *tmp ? tmp : "/tmp";
+#elif defined(_WINDOWS)
+        char buf[MAX_PATH + 1] = {};
+        DWORD n = GetTempPathA(sizeof(buf), buf);
+        if (n == 0 || n > MAX_PATH) {
+            return ".";
+        }
+        // GetTempPathA already appends a trailing backslash
+        buf[n - 1] = '\0';
+        return buf;
+#else
+        return ".";
+#endif
+    }
+
+} // namespace
+
+flight_recorder::flight_recorder(size_t capacity)
+    : _capacity(capacity)
+{
+    const size_t total = sizeof(ring_header) + sizeof(record_desc) * INDEX_ENTRIES + capacity;
+
+#ifdef linux
+    _path = recorder_dir() + "/audio-share-recorder-" + std::to_string(getpid()) + ".ring";
+    int fd = open(_path.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0600);
+    if (fd < 0) {
+        spdlog::info("flight recorder unavailable ({}), dumps disabled", strerror(errno));
+        return;
+    }
+    if (ftruncate(fd, (off_t)total) != 0) {
+        spdlog::info("flight recorder ftruncate failed ({}), dumps disabled", strerror(errno));
+        close(fd);
+        unlink(_path.c_str());
+        return;
+    }
+    void* base = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        spdlog::info("flight recorder mmap failed ({}), dumps disabled", strerror(errno));
+        close(fd);
+        unlink(_path.c_str());
+        return;
+    }
+    _fd = fd;
+    _header = (ring_header*)base;
+#endif
+
+#ifdef _WINDOWS
+    _path = recorder_dir() + "\\audio-share-recorder-" + std::to_string(GetCurrentProcessId()) + ".ring";
+    HANDLE file = CreateFileA(_path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ,
+        nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        spdlog::info("flight recorder unavailable ({}), dumps disabled", str_win_err((int)GetLastError()));
+        return;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE,
+        (DWORD)((uint64_t)total >> 32), (DWORD)(total & 0xffffffffu), nullptr);
+    if (!mapping) {
+        spdlog::info("flight recorder mapping failed ({}), dumps disabled", str_win_err((int)GetLastError()));
+        CloseHandle(file);
+        return;
+    }
+    void* base = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, total);
+    if (!base) {
+        spdlog::info("flight recorder map view failed ({}), dumps disabled", str_win_err((int)GetLastError()));
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return;
+    }
+    _file = file;
+    _mapping = mapping;
+    _header = (ring_header*)base;
+#endif
+
+    if (!_header) {
+        return;
+    }
+
+    _index = (record_desc*)((char*)_header + sizeof(ring_header));
+    _ring = (char*)_index + sizeof(record_desc) * INDEX_ENTRIES;
+    _header->capacity = capacity;
+    _header->write_pos = 0;
+    _header->seq = 0;
+    _header->version = VERSION;
+    // Magic last, so a crash dump of a half-initialized ring is never parsed
+    _header->magic = MAGIC;
+    spdlog::info("flight recorder ready: {} ({} KiB)", _path, capacity / 1024);
+}
+
+flight_recorder::~flight_recorder()
+{
+#ifdef linux
+    if (_header) {
+        munmap(_header, sizeof(ring_header) + sizeof(record_desc) * INDEX_ENTRIES + _capacity);
+    }
+    if (_fd >= 0) {
+        close(_fd);
+        unlink(_path.c_str());
+    }
+#endif
+#ifdef _WINDOWS
+    if (_header) {
+        UnmapViewOfFile(_header);
+    }
+    if (_mapping) {
+        CloseHandle((HANDLE)_mapping);
+    }
+    if (_file) {
+        CloseHandle((HANDLE)_file);
+        DeleteFileA(_path.c_str());
+    }
+#endif
+}
+
+void flight_recorder::record(const char* data, uint32_t size, int32_t block_align, uint64_t capture_us)
+{
+    if (!_header || size == 0 || size > _capacity) {
+        return;
+    }
+
+    // Single writer on the broadcast strand, so plain stores are enough; the
+    // mapping is only ever read in-process after the writer is quiesced, or
+    // post-mortem from the file
+    const uint64_t pos = _header->write_pos;
+    write_bytes(pos, data, size);
+
+    record_desc& desc = _index[_header->seq & (INDEX_ENTRIES - 1)];
+    desc.pos = pos;
+    desc.capture_us = capture_us;
+    desc.size = size;
+    desc.block_align = block_align;
+
+    _header->write_pos = pos + size;
+    _header->seq += 1;
+}
+
+std::string flight_recorder::dump()
+{
+    if (!_header) {
+        return {};
+    }
+
+    const uint64_t seq = _header->seq;
+    const uint64_t write_pos = _header->write_pos;
+    const uint64_t first = seq > INDEX_ENTRIES ? seq - INDEX_ENTRIES : 0;
+
+    // Serialize the surviving records oldest-first while the writer is
+    // quiesced; the file write itself happens off-strand
+    std::vector<uint8_t> snapshot;
+    snapshot.reserve(std::min<uint64_t>(write_pos, _capacity) + (seq - first) * (sizeof(record_desc) + 8));
+    uint32_t count = 0;
+    for (uint64_t s = first; s < seq; ++s) {
+        const record_desc& desc = _index[s & (INDEX_ENTRIES - 1)];
+        if (write_pos - desc.pos > _capacity) {
+            // Payload already overwritten by newer quanta
+            continue;
+        }
+        const size_t base = snapshot.size();
+        snapshot.resize(base + sizeof(desc.size) + sizeof(desc.block_align) + sizeof(desc.capture_us) + desc.size);
+        uint8_t* out = snapshot.data() + base;
+        std::memcpy(out, &desc.size, sizeof(desc.size));
+        out += sizeof(desc.size);
+        std::memcpy(out, &desc.block_align, sizeof(desc.block_align));
+        out += sizeof(desc.block_align);
+        std::memcpy(out, &desc.capture_us, sizeof(desc.capture_us));
+        out += sizeof(desc.capture_us);
+        const size_t off = (size_t)(desc.pos & (_capacity - 1));
+        const size_t head = std::min<size_t>(desc.size, _capacity - off);
+        std::memcpy(out, _ring + off, head);
+        std::memcpy(out + head, _ring, desc.size - head);
+        ++count;
+    }
+
+    const auto now = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    std::string path = _path.substr(0, _path.size() - sizeof(".ring") + 1)
+        + "-" + std::to_string(now) + ".dump";
+
+    std::thread([path, count, snapshot = std::move(snapshot)]() {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            spdlog::warn("flight recorder dump failed to open {}", path);
+            return;
+        }
+        const uint32_t magic = MAGIC;
+        const uint32_t version = VERSION;
+        out.write((const char*)&magic, sizeof(magic));
+        out.write((const char*)&version, sizeof(version));
+        out.write((const char*)&count, sizeof(count));
+        out.write((const char*)snapshot.data(), (std::streamsize)snapshot.size());
+        spdlog::info("flight recorder dumped {} quanta to {}", count, path);
+    }).detach();
+
+    return path;
+}
+
+void flight_recorder::write_bytes(uint64_t pos, const void* src, size_t n)
+{
+    const size_t off = (size_t)(pos & (_capacity - 1));
+    const size_t first = std::min(n, _capacity - off);
+    std::memcpy(_ring + off, src, first);
+    std::memcpy(_ring, (const char*)src + first, n - first);
+}
+
+} // namespace audio_share
@@ -0,0 +1,117 @@
+/*
+   Copyright 2022-2024 mkckr0 <https://github.com/mkckr0>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef FLIGHT_RECORDER_HPP
+#define FLIGHT_RECORDER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace audio_share {
+
+/**
+ * @brief Always-on memory-mapped flight recorder for the broadcast stream.
+ *
+ * A file-backed mapping holds the last few seconds of PCM plus per-quantum
+ * metadata: a fixed ring of record descriptors (seq-indexed) and a
+ * power-of-2 payload byte ring. The hot path is plain stores into the
+ * mapping - no syscalls - and the OS writes pages back lazily, so steady
+ * state costs one memcpy per quantum. The backing file survives a crash,
+ * which is the whole point: what the server actually broadcast is always
+ * inspectable after the fact.
+ *
+ * dump() snapshots the ring into a timestamped sidecar file of
+ * self-delimiting records ([size][block_align][capture_us][payload]) and
+ * returns its path. Snapshotting copies from the mapping in memory; only
+ * the sidecar write touches the filesystem, on a detached thread. record()
+ * and dump() must both run on the broadcast strand so a dump never tears a
+ * record mid-write.
+ */
+class flight_recorder {
+public:
+#pragma pack(push, 1)
+    struct ring_header {
+        uint32_t magic;     // MAGIC, so a stale file is never misread
+        uint32_t version;   // bump on any layout change
+        uint64_t capacity;  // payload ring bytes, power of 2
+        uint64_t write_pos; // monotonic payload byte cursor
+        uint64_t seq;       // record counter, indexes the descriptor ring
+    };
+
+    struct record_desc {
+        uint64_t pos;        // payload start, monotonic byte position
+        uint64_t capture_us; // capture timestamp of the quantum
+        uint32_t size;       // payload bytes
+        int32_t block_align; // frame size of the quantum
+    };
+#pragma pack(pop)
+
+    static constexpr uint32_t MAGIC = 0x52464c41u;  // "ALFR" read as LE u32
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t INDEX_ENTRIES = 4096;  // Descriptor ring, power of 2
+
+    /**
+     * @brief Map the ring file in the system temp directory
+     * @param capacity Payload ring capacity in bytes, must be a power of 2
+     */
+    explicit flight_recorder(size_t capacity);
+    ~flight_recorder();
+
+    flight_recorder(const flight_recorder&) = delete;
+    flight_recorder& operator=(const flight_recorder&) = delete;
+
+    /**
+     * @brief Whether the mapping was set up successfully
+     */
+    bool valid() const { return _header != nullptr; }
+
+    /**
+     * @brief Backing ring file path
+     */
+    const std::string& path() const { return _path; }
+
+    /**
+     * @brief Record one broadcast quantum. Plain stores only.
+     */
+    void record(const char* data, uint32_t size, int32_t block_align, uint64_t capture_us);
+
+    /**
+     * @brief Snapshot the ring to a sidecar dump file
+     * @return The dump file path, or empty on failure
+     */
+    std::string dump();
+
+private:
+    void write_bytes(uint64_t pos, const void* src, size_t n);
+
+    std::string _path;
+    ring_header* _header = nullptr;
+    record_desc* _index = nullptr;
+    char* _ring = nullptr;
+    size_t _capacity = 0;
+#ifdef linux
+    int _fd = -1;
+#endif
+#ifdef _WINDOWS
+    void* _file = nullptr;
+    void* _mapping = nullptr;
+#endif
+};
+
+} // namespace audio_share
+
+#endif // !FLIGHT_RECORDER_HPP
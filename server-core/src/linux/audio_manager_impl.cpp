@@ -19,10 +19,13 @@
 #include "audio_manager.hpp"
 #include "client.pb.h"
 #include "network_manager.hpp"
+#include "sample_mixer.hpp"
 
+#include <algorithm>
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <memory>
 #include <stdexcept>
 #include <vector>
 
@@ -32,6 +35,24 @@
 
 using namespace io::github::mkckr0::audio_share_app::pb;
 
+// Wire layout of the negotiated capture format, for the mixer kernels
+static audio_share::sample_mixer::mix_encoding to_mix_encoding(AudioFormat_Encoding encoding)
+{
+    using mix = audio_share::sample_mixer::mix_encoding;
+    switch (encoding) {
+    case AudioFormat_Encoding_ENCODING_PCM_8BIT:
+        return mix::u8;
+    case AudioFormat_Encoding_ENCODING_PCM_16BIT:
+        return mix::s16;
+    case AudioFormat_Encoding_ENCODING_PCM_24BIT:
+        return mix::s24;
+    case AudioFormat_Encoding_ENCODING_PCM_32BIT:
+        return mix::s32;
+    default:
+        return mix::f32;
+    }
+}
+
 struct roundtrip {
     struct pw_core* _core;
     int _sync;
@@ -85,10 +106,34 @@ audio_manager_impl::audio_manager_impl()
         ._sync = 0,
         ._loop = _loop,
     };
+
+    // Subscribe once for endpoint cache invalidation. The listener fires
+    // whenever the loop runs - during any roundtrip and for the whole time
+    // the capture stream is up - so hotplug reliably dirties the cache.
+    static const struct pw_registry_events registry_events = {
+        .version = PW_VERSION_REGISTRY_EVENTS,
+        .global = [](void* object, uint32_t id, uint32_t permissions, const char* type, uint32_t version, const struct spa_dict* props) {
+            if (spa_streq(type, PW_TYPE_INTERFACE_Node)
+                && spa_streq(spa_dict_lookup(props, PW_KEY_MEDIA_CLASS), "Audio/Sink")) {
+                ((std::atomic<bool>*)object)->store(true, std::memory_order_release);
+            }
+        },
+        .global_remove = [](void* object, uint32_t id) {
+            // Removal carries no properties to filter on, invalidate
+            // conservatively
+            ((std::atomic<bool>*)object)->store(true, std::memory_order_release);
+        },
+    };
+    _registry = pw_core_get_registry(_core, PW_VERSION_REGISTRY, 0);
+    _registry_listener = new spa_hook {};
+    pw_registry_add_listener(_registry, _registry_listener, &registry_events, &_endpoint_cache_dirty);
 }
 
 audio_manager_impl::~audio_manager_impl()
 {
+    spa_hook_remove(_registry_listener);
+    delete _registry_listener;
+    pw_proxy_destroy((struct pw_proxy*)_registry);
     pw_core_disconnect(_core);
     pw_context_destroy(_context);
     pw_main_loop_destroy(_loop);
@@ -152,6 +197,14 @@ void audio_manager::do_loopback_recording(std::shared_ptr<network_manager> netwo
         spa_sample_rate = config.sample_rate;
     }
 
+    // One secondary capture stream per extra endpoint. Every stream's
+    // process callback runs on the context's one data loop, so the fifos
+    // need no locking: secondaries append, the primary mixes and consumes.
+    struct mix_source_t {
+        struct pw_stream* stream = nullptr;
+        std::vector<uint8_t> fifo;  // Pending bytes, capture thread only
+    };
+
     struct user_data_t {
         struct pw_main_loop* loop;
         struct pw_stream* stream;
@@ -159,6 +212,8 @@ void audio_manager::do_loopback_recording(std::shared_ptr<network_manager> netwo
         std::shared_ptr<AudioFormat> format;
         int block_align;
         bool format_error;  // Flag to indicate unsupported audio format
+        std::vector<std::unique_ptr<mix_source_t>> sources;
+        std::vector<uint8_t> mix_scratch;  // Mixed quantum, reused across callbacks
     } user_data = {
         .loop = _loop,
         .stream = nullptr,
@@ -166,6 +221,8 @@ void audio_manager::do_loopback_recording(std::shared_ptr<network_manager> netwo
         .format = _format,
         .block_align = 0,
         .format_error = false,
+        .sources = {},
+        .mix_scratch = {},
     };
 
     static const struct pw_stream_events stream_events = {
@@ -312,8 +369,24 @@ void audio_manager::do_loopback_recording(std::shared_ptr<network_manager> netwo
             auto begin = (const char*)buf->datas[0].data + buf->datas[0].chunk->offset;
             auto count = buf->datas[0].chunk->size;
 
-            user_data->network_manager->broadcast_audio_data(begin, count, user_data->block_align);
-    
+            if (user_data->sources.empty()) {
+                user_data->network_manager->broadcast_audio_data(begin, count, user_data->block_align);
+            } else {
+                // Fold the pending secondary bytes in once per quantum, on
+                // this thread; per-client work stays out of the mixer
+                auto& scratch = user_data->mix_scratch;
+                scratch.assign((const uint8_t*)begin, (const uint8_t*)begin + count);
+                auto encoding = to_mix_encoding(user_data->format->encoding());
+                for (auto& source : user_data->sources) {
+                    size_t n = std::min(source->fifo.size(), (size_t)count);
+                    if (n) {
+                        audio_share::sample_mixer::mix_into(scratch.data(), source->fifo.data(), n, encoding);
+                        source->fifo.erase(source->fifo.begin(), source->fifo.begin() + n);
+                    }
+                }
+                user_data->network_manager->broadcast_audio_data((const char*)scratch.data(), count, user_data->block_align);
+            }
+
             pw_stream_queue_buffer(user_data->stream, b);
         },
     };
@@ -327,6 +400,16 @@ void audio_manager::do_loopback_recording(std::shared_ptr<network_manager> netwo
         PW_KEY_TARGET_OBJECT, selected_endpoint_id.c_str(),
         nullptr);
 
+    if (config.latency > 0) {
+        // Ask the graph to run our node at this quantum. The node rate pins
+        // the latency fraction's denominator so "128/48000" means 128 frames
+        // at 48kHz regardless of the graph's current rate.
+        uint32_t latency_rate = config.sample_rate ? config.sample_rate : 48000;
+        pw_properties_setf(props, PW_KEY_NODE_LATENCY, "%d/%u", config.latency, latency_rate);
+        pw_properties_setf(props, PW_KEY_NODE_RATE, "1/%u", latency_rate);
+        spdlog::info("request node latency: {}/{}", config.latency, latency_rate);
+    }
+
     user_data.stream = pw_stream_new_simple(pw_main_loop_get_loop(_loop), "audio-share-server", props, &stream_events, &user_data);
 
     // clang-format off
@@ -347,8 +430,65 @@ void audio_manager::do_loopback_recording(std::shared_ptr<network_manager> netwo
             | PW_STREAM_FLAG_RT_PROCESS),
         params, 1);
 
+    // Secondary capture streams for the extra endpoints, same requested
+    // format as the primary; every stream follows the graph's rate, so
+    // aligned quanta line up byte for byte
+    static const struct pw_stream_events mix_source_events = {
+        .version = PW_VERSION_STREAM_EVENTS,
+        .process = [](void* data) {
+            auto* source = (mix_source_t*)data;
+            struct pw_buffer* b;
+            if ((b = pw_stream_dequeue_buffer(source->stream)) == nullptr) {
+                pw_log_warn("out of buffers: %m");
+                return;
+            }
+            auto* buf = b->buffer;
+            if (buf->datas[0].data != nullptr) {
+                auto begin = (const uint8_t*)buf->datas[0].data + buf->datas[0].chunk->offset;
+                auto count = buf->datas[0].chunk->size;
+                auto& fifo = source->fifo;
+                fifo.insert(fifo.end(), begin, begin + count);
+                // Bound the backlog so a source that outpaces the primary
+                // (rate drift, primary stall) sheds its oldest audio
+                constexpr size_t MAX_FIFO = 256 * 1024;
+                if (fifo.size() > MAX_FIFO) {
+                    fifo.erase(fifo.begin(), fifo.end() - MAX_FIFO);
+                }
+            }
+            pw_stream_queue_buffer(source->stream, b);
+        },
+    };
+
+    for (const auto& mix_id : config.mix_endpoint_ids) {
+        auto source = std::make_unique<mix_source_t>();
+        struct pw_properties* mix_props = pw_properties_new(
+            PW_KEY_MEDIA_TYPE, "Audio",
+            PW_KEY_MEDIA_CATEGORY, "Capture",
+            PW_KEY_MEDIA_ROLE, "Music",
+            PW_KEY_APP_NAME, "Audio Share Server",
+            PW_KEY_NODE_NAME, "Audio Share Server Mix",
+            PW_KEY_TARGET_OBJECT, mix_id.c_str(),
+            nullptr);
+        if (config.latency > 0) {
+            uint32_t latency_rate = config.sample_rate ? config.sample_rate : 48000;
+            pw_properties_setf(mix_props, PW_KEY_NODE_LATENCY, "%d/%u", config.latency, latency_rate);
+            pw_properties_setf(mix_props, PW_KEY_NODE_RATE, "1/%u", latency_rate);
+        }
+        source->stream = pw_stream_new_simple(pw_main_loop_get_loop(_loop), "audio-share-server-mix", mix_props, &mix_source_events, source.get());
+        pw_stream_connect(source->stream, PW_DIRECTION_INPUT, PW_ID_ANY,
+            pw_stream_flags(PW_STREAM_FLAG_AUTOCONNECT
+                | PW_STREAM_FLAG_MAP_BUFFERS
+                | PW_STREAM_FLAG_RT_PROCESS),
+            params, 1);
+        spdlog::info("mixing additional endpoint: {}", mix_id);
+        user_data.sources.push_back(std::move(source));
+    }
+
     pw_main_loop_run(_loop);
 
+    for (auto& source : user_data.sources) {
+        pw_stream_destroy(source->stream);
+    }
     pw_stream_destroy(user_data.stream);
 
     // Check for format error after stream processing
@@ -357,8 +497,11 @@ void audio_manager::do_loopback_recording(std::shared_ptr<network_manager> netwo
     }
 }
 
-audio_manager::endpoint_list_t audio_manager::get_endpoint_list()
+void audio_manager::refresh_endpoint_cache()
 {
+    // One roundtrip fills both the list and the default: the registry replay
+    // already carries every sink's session priority, so there is no reason
+    // to pay a second roundtrip for the default endpoint
     struct user_data_t {
         endpoint_list_t* endpoint_list_ptr;
         int default_index;
@@ -407,49 +550,11 @@ audio_manager::endpoint_list_t audio_manager::get_endpoint_list()
     (*_roundtrip)();
 
     pw_proxy_destroy((struct pw_proxy*)registry);
-    return endpoint_list;
-}
 
-std::string audio_manager::get_default_endpoint()
-{
-    struct user_data_t {
-        int default_priority;
-        std::string default_id;
-    };
-
-    static const struct pw_registry_events registry_events = {
-        .version = PW_VERSION_REGISTRY_EVENTS,
-        .global = [](void* object, uint32_t id, uint32_t permissions, const char* type, uint32_t version, const struct spa_dict* props) {
-            if (spa_streq(type, PW_TYPE_INTERFACE_Node)) {
-                const char* media_class = spa_dict_lookup(props, PW_KEY_MEDIA_CLASS);
-
-                if (!spa_streq(media_class, "Audio/Sink")) {
-                    return;
-                }
-
-                auto user_data = (user_data_t*)object;
-                const char* priority_session = spa_dict_lookup(props, PW_KEY_PRIORITY_SESSION);
-                const char* object_serial = spa_dict_lookup(props, PW_KEY_OBJECT_SERIAL);
-
-                int priority = priority_session ? std::stoi(priority_session) : -1;
-                if (priority > user_data->default_priority) {
-                    user_data->default_priority = priority;
-                    user_data->default_id = object_serial;
-                }
-            }
-        },
-    };
-
-    struct pw_registry* registry = pw_core_get_registry(_core, PW_VERSION_REGISTRY, 0);
-    struct spa_hook registry_listener {};
-    struct user_data_t user_data = {
-        .default_priority = -1,
-    };
-    pw_registry_add_listener(registry, &registry_listener, &registry_events, &user_data);
-    (*_roundtrip)();
-
-    pw_proxy_destroy((struct pw_proxy*)registry);
-    return user_data.default_id;
+    _endpoint_cache = std::move(endpoint_list);
+    _default_endpoint_cache = user_data.default_index >= 0
+        ? _endpoint_cache[user_data.default_index].first
+        : std::string {};
 }
 
 #endif // linux
\ No newline at end of file
@@ -19,11 +19,15 @@
 
 #ifdef linux
 
+#include <atomic>
+
 class network_manager;
 
 struct pw_main_loop;
 struct pw_context;
 struct pw_core;
+struct pw_registry;
+struct spa_hook;
 struct roundtrip;
 
 namespace detail {
@@ -37,6 +41,11 @@ protected:
     struct pw_context* _context;
     struct pw_core* _core;
     struct roundtrip* _roundtrip;
+    // Persistent registry binding whose listener invalidates the endpoint
+    // cache when an Audio/Sink node appears or any object goes away
+    struct pw_registry* _registry;
+    struct spa_hook* _registry_listener;
+    std::atomic<bool> _endpoint_cache_dirty { true };
 };
 
 } // namespace detail
@@ -0,0 +1,86 @@
+/*
+   Copyright 2022-2024 mkckr0 <https://github.com/mkckr0>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef LOGGING_HPP
+#define LOGGING_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include <spdlog/async.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+
+namespace audio_share {
+
+/**
+ * @brief Switch the default logger to an async logger with a bounded queue.
+ *
+ * Formatting and the sink write happen on a dedicated background thread, so
+ * a log call on the audio or net path is just an enqueue. The queue is
+ * bounded and overruns drop the oldest entry instead of blocking the
+ * caller: enabling trace logging can lose lines under load, but it can
+ * never stall the path it is observing.
+ */
+inline void init_async_logging()
+{
+    constexpr size_t LOG_QUEUE_CAPACITY = 8192;
+    spdlog::init_thread_pool(LOG_QUEUE_CAPACITY, 1);
+    auto logger = std::make_shared<spdlog::async_logger>("audio_share",
+        std::make_shared<spdlog::sinks::stdout_color_sink_mt>(),
+        spdlog::thread_pool(), spdlog::async_overflow_policy::overrun_oldest);
+    spdlog::set_default_logger(std::move(logger));
+    spdlog::flush_on(spdlog::level::err);
+    spdlog::flush_every(std::chrono::seconds(3));
+}
+
+} // namespace audio_share
+
+/**
+ * @brief Rate-limited log for per-packet call sites.
+ *
+ * Emits at most one line per interval_ms per call site and counts the rest;
+ * the next emitted line carries the suppressed count. A burst of thousands
+ * of identical send errors costs one enqueue per interval plus a relaxed
+ * counter bump each, instead of flooding the queue and evicting every other
+ * message.
+ */
+#define AUDIO_SHARE_LOG_EVERY_MS(lvl, interval_ms, ...)                                               \
+    do {                                                                                              \
+        if (!spdlog::should_log(lvl)) {                                                               \
+            break;                                                                                    \
+        }                                                                                             \
+        static std::atomic<int64_t> _log_last_us { 0 };                                               \
+        static std::atomic<uint64_t> _log_suppressed { 0 };                                           \
+        const int64_t _log_now_us = std::chrono::duration_cast<std::chrono::microseconds>(            \
+            std::chrono::steady_clock::now().time_since_epoch()).count();                             \
+        int64_t _log_prev_us = _log_last_us.load(std::memory_order_relaxed);                          \
+        if (_log_now_us - _log_prev_us >= (int64_t)(interval_ms) * 1000                               \
+            && _log_last_us.compare_exchange_strong(_log_prev_us, _log_now_us,                        \
+                std::memory_order_relaxed)) {                                                         \
+            const uint64_t _log_dropped = _log_suppressed.exchange(0, std::memory_order_relaxed);     \
+            if (_log_dropped) {                                                                       \
+                spdlog::log(lvl, "{} [{} similar suppressed]", fmt::format(__VA_ARGS__), _log_dropped); \
+            } else {                                                                                  \
+                spdlog::log(lvl, __VA_ARGS__);                                                        \
+            }                                                                                         \
+        } else {                                                                                      \
+            _log_suppressed.fetch_add(1, std::memory_order_relaxed);                                  \
+        }                                                                                             \
+    } while (0)
+
+#endif // !LOGGING_HPP
@@ -1,5 +1,7 @@
 #include "config.h"
 #include "audio_manager.hpp"
+#include "client_simulator.hpp"
+#include "logging.hpp"
 #include "network_manager.hpp"
 #include "websocket_manager.hpp"
 #include "constants.hpp"
@@ -15,6 +17,9 @@ using namespace audio_share::constants;
 
 int main(int argc, char* argv[])
 {
+    // Logging must never stall the audio or net threads, even at trace level
+    audio_share::init_async_logging();
+
     auto default_address = network_manager::get_default_address();
 
     std::string help_string = "Example:\n";
@@ -32,10 +37,23 @@ int main(int argc, char* argv[])
         ("b,bind", "The server bind address. If not set, will use default", cxxopts::value<string>()->implicit_value(default_address), "[host][:<port>]")
         ("w,websocket-port", "WebSocket server port for web browser clients (default: main port + 1)", cxxopts::value<int>()->default_value("0"), "[port]")
         ("e,endpoint", "Specify the endpoint id. If not set or set \"default\", will use default", cxxopts::value<string>()->default_value("default"), "[endpoint]")
+        ("mix-endpoint", "Mix an additional endpoint (e.g. a microphone) into the feed. May be repeated", cxxopts::value<std::vector<string>>(), "[endpoint]")
         ("encoding", "Specify the capture encoding. If not set or set \"default\", will use default", cxxopts::value<audio_manager::encoding_t>()->default_value("default"), "[encoding]")
         ("list-encoding", "List available encoding")
         ("channels", "Specify the capture channels. If not set or set \"0\", will use default", cxxopts::value<int>()->default_value("0"), "[channels]")
+        ("net-threads", "Number of network threads. If not set or set \"0\", will use min(4, hardware threads)", cxxopts::value<int>()->default_value("0"), "[count]")
+        ("multicast", "Enable multicast streaming to the given IPv4 group. Capable clients join the group, others stay on unicast", cxxopts::value<string>()->default_value(""), "<group>[:<port>]")
         ("sample-rate", "Specify the capture sample rate(Hz). If not set or set \"0\", will use default. The common values are 44100, 48000, etc.", cxxopts::value<int>()->default_value("0"), "[sample_rate]")
+        ("latency", "Target capture latency in frames (PipeWire quantum, e.g. 128). If not set or set \"0\", will use the graph default", cxxopts::value<int>()->default_value("0"), "[frames]")
+        ("raw", "Request a raw capture stream that bypasses the audio engine's processing chain (Windows only). Falls back to the normal stream if the device refuses")
+        ("silence-hangover", "Suppress broadcast after this many milliseconds of digital silence, keeping a tiny keepalive. Set \"0\" to disable the silence gate", cxxopts::value<int>()->default_value(std::to_string(DEFAULT_SILENCE_HANGOVER_MS)), "[ms]")
+        ("sndbuf", "UDP socket send buffer size in bytes. If not set or set \"0\", will use the kernel default", cxxopts::value<int>()->default_value("0"), "[bytes]")
+        ("dscp", "DSCP code point for audio traffic (46 = Expedited Forwarding). Set \"-1\" to disable marking", cxxopts::value<int>()->default_value("46"), "[dscp]")
+        ("busy-poll", "SO_BUSY_POLL busy-wait budget in microseconds (Linux only, needs CAP_NET_ADMIN). If not set or set \"0\", disabled", cxxopts::value<int>()->default_value("0"), "[usec]")
+        ("pace", "Spread each quantum's UDP packets over this many timed trains instead of one burst, easing Wi-Fi queue overruns. If not set or set \"0\", disabled", cxxopts::value<int>()->default_value("0"), "[trains]")
+        ("simulate-clients", "Spin up this many in-process clients speaking the real protocol against the server, for load and regression testing", cxxopts::value<int>()->default_value("0"), "[count]")
+        ("simulate-seconds", "How long the simulated clients play before the run is reported", cxxopts::value<int>()->default_value("10"), "[seconds]")
+        ("measure-latency", "Report per-client capture to receive latency percentiles for the simulated run")
         ("V,verbose", "Set log level to \"trace\"")
         ("v,version", "Show version")
         ;
@@ -136,26 +154,94 @@ int main(int argc, char* argv[])
             audio_manager::capture_config capture_config;
 
             capture_config.endpoint_id = result["endpoint"].as<string>();
+            if (result.count("mix-endpoint")) {
+                capture_config.mix_endpoint_ids = result["mix-endpoint"].as<std::vector<string>>();
+            }
             capture_config.encoding = result["encoding"].as<audio_manager::encoding_t>();
             capture_config.channels = result["channels"].as<int>();
             capture_config.sample_rate = result["sample-rate"].as<int>();
+            capture_config.latency = result["latency"].as<int>();
+            capture_config.raw_mode = result.count("raw") > 0;
+            if (capture_config.latency < 0) {
+                spdlog::error("Latency cannot be negative, got {}", capture_config.latency);
+                return EXIT_FAILURE;
+            }
 
             auto network_manager = std::make_shared<class network_manager>(audio_manager);
+            network_manager->set_net_thread_count(result["net-threads"].as<int>());
 
-            // Start WebSocket server for web clients
+            int silence_hangover = result["silence-hangover"].as<int>();
+            if (silence_hangover < 0) {
+                spdlog::error("Silence hangover cannot be negative, got {}", silence_hangover);
+                return EXIT_FAILURE;
+            }
+            network_manager->set_silence_hangover(silence_hangover);
+
+            audio_share::socket_tuner::config_t tuning;
+            tuning.sndbuf = result["sndbuf"].as<int>();
+            tuning.dscp = result["dscp"].as<int>();
+            tuning.busy_poll_us = result["busy-poll"].as<int>();
+            if (tuning.dscp > 63) {
+                spdlog::error("DSCP must be in 0..63 (or -1 to disable), got {}", tuning.dscp);
+                return EXIT_FAILURE;
+            }
+            network_manager->set_socket_tuning(tuning);
+
+            int pace_trains = result["pace"].as<int>();
+            if (pace_trains < 0) {
+                spdlog::error("Pace train count cannot be negative, got {}", pace_trains);
+                return EXIT_FAILURE;
+            }
+            network_manager->set_pacing(pace_trains);
+
+            auto multicast = result["multicast"].as<string>();
+            if (!multicast.empty()) {
+                size_t sep = multicast.find(':');
+                string group = multicast.substr(0, sep);
+                uint16_t multicast_port = port;
+                if (sep != string::npos) {
+                    int port_val = std::stoi(multicast.substr(sep + 1));
+                    if (port_val < MIN_PORT || port_val > MAX_PORT) {
+                        spdlog::error("Multicast port must be between {} and {}, got {}", MIN_PORT, MAX_PORT, port_val);
+                        return EXIT_FAILURE;
+                    }
+                    multicast_port = static_cast<uint16_t>(port_val);
+                }
+                network_manager->set_multicast(group, multicast_port);
+            }
+
+            network_manager->start_server(host, port, capture_config);
+
+            // Start WebSocket server for web clients on the network
+            // manager's io_context, sharing its thread pool
             auto ws_manager = std::make_shared<class websocket_manager>(audio_manager);
             int ws_port_val = result["websocket-port"].as<int>();
-            uint16_t ws_port = (ws_port_val > 0 && ws_port_val <= MAX_PORT) 
-                ? static_cast<uint16_t>(ws_port_val) 
+            uint16_t ws_port = (ws_port_val > 0 && ws_port_val <= MAX_PORT)
+                ? static_cast<uint16_t>(ws_port_val)
                 : static_cast<uint16_t>(port + 1);
-            
+
             spdlog::info("Starting WebSocket server on {}:{}", host, ws_port);
-            ws_manager->start_server(host, ws_port, capture_config);
-            
+            ws_manager->start_server(network_manager->_ioc, host, ws_port, capture_config);
+
             // Register WebSocket manager as additional broadcaster
             network_manager->add_broadcaster(ws_manager);
 
-            network_manager->start_server(host, port, capture_config);
+            int simulate_clients = result["simulate-clients"].as<int>();
+            if (simulate_clients > 0) {
+                // Load-generation mode: play against our own server from
+                // in-process clients, report, then shut down
+                audio_share::client_simulator::config_t sim_config;
+                sim_config.host = host;
+                sim_config.port = port;
+                sim_config.clients = simulate_clients;
+                sim_config.duration_seconds = result["simulate-seconds"].as<int>();
+                sim_config.measure_latency = result.count("measure-latency") > 0;
+                bool ok = audio_share::client_simulator::run(sim_config);
+                network_manager->stop_server();
+                ws_manager->stop_server();
+                return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+            }
+
             network_manager->wait_server();
             ws_manager->stop_server();
 
@@ -0,0 +1,128 @@
+/*
+   Copyright 2022-2024 mkckr0 <https://github.com/mkckr0>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace audio_share {
+
+/**
+ * @brief Process-wide hot-path instrumentation: atomic counters and
+ *        fixed-bucket histograms, no locks anywhere.
+ *
+ * Recording is a single relaxed fetch_add, cheap enough for the capture
+ * callback and the per-segment send path. Readers snapshot the counters
+ * with relaxed loads; a slightly torn view across counters is fine for
+ * dashboards. Exposed through cmd_get_stats on the TCP control protocol
+ * and GET /stats on the WebSocket port.
+ */
+class metrics {
+public:
+    /**
+     * @brief Latency histogram with power-of-two microsecond buckets.
+     *
+     * Bucket i counts samples in [2^i, 2^(i+1)) us, so 16 buckets cover
+     * 1 us through ~65 ms, plenty for capture-to-socket latency.
+     */
+    class latency_histogram {
+    public:
+        static constexpr size_t NUM_BUCKETS = 16;
+
+        void record(uint64_t us)
+        {
+            size_t bucket = 0;
+            while (bucket + 1 < NUM_BUCKETS && us >= (uint64_t(2) << bucket)) {
+                ++bucket;
+            }
+            _buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+            _sum_us.fetch_add(us, std::memory_order_relaxed);
+            _count.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        std::string to_json() const
+        {
+            std::string json = "{\"count\":" + std::to_string(_count.load(std::memory_order_relaxed));
+            json += ",\"sum_us\":" + std::to_string(_sum_us.load(std::memory_order_relaxed));
+            json += ",\"buckets_us\":[";
+            for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+                if (i) {
+                    json += ',';
+                }
+                json += std::to_string(_buckets[i].load(std::memory_order_relaxed));
+            }
+            json += "]}";
+            return json;
+        }
+
+    private:
+        std::atomic<uint64_t> _buckets[NUM_BUCKETS] {};
+        std::atomic<uint64_t> _sum_us { 0 };
+        std::atomic<uint64_t> _count { 0 };
+    };
+
+    static metrics& instance()
+    {
+        static metrics s_instance;
+        return s_instance;
+    }
+
+    void on_quantum_captured() { _quanta_captured.fetch_add(1, std::memory_order_relaxed); }
+    void on_quantum_suppressed() { _quanta_suppressed.fetch_add(1, std::memory_order_relaxed); }
+    void on_segments_sent(uint64_t n) { _segments_sent.fetch_add(n, std::memory_order_relaxed); }
+    void on_send_error() { _send_errors.fetch_add(1, std::memory_order_relaxed); }
+    void on_queue_drop() { _queue_drops.fetch_add(1, std::memory_order_relaxed); }
+    void on_peer_reported_loss(uint64_t n) { _peer_reported_loss.fetch_add(n, std::memory_order_relaxed); }
+    void on_capture_to_send(uint64_t us) { _capture_to_send_us.record(us); }
+    void set_device_period_us(uint64_t us) { _device_period_us.store(us, std::memory_order_relaxed); }
+
+    /**
+     * @brief Render all counters and histograms as one JSON object
+     */
+    std::string to_json() const
+    {
+        std::string json = "{";
+        json += "\"quanta_captured\":" + std::to_string(_quanta_captured.load(std::memory_order_relaxed));
+        json += ",\"quanta_suppressed\":" + std::to_string(_quanta_suppressed.load(std::memory_order_relaxed));
+        json += ",\"segments_sent\":" + std::to_string(_segments_sent.load(std::memory_order_relaxed));
+        json += ",\"send_errors\":" + std::to_string(_send_errors.load(std::memory_order_relaxed));
+        json += ",\"queue_drops\":" + std::to_string(_queue_drops.load(std::memory_order_relaxed));
+        json += ",\"peer_reported_loss\":" + std::to_string(_peer_reported_loss.load(std::memory_order_relaxed));
+        json += ",\"device_period_us\":" + std::to_string(_device_period_us.load(std::memory_order_relaxed));
+        json += ",\"capture_to_send\":" + _capture_to_send_us.to_json();
+        json += "}";
+        return json;
+    }
+
+private:
+    metrics() = default;
+
+    std::atomic<uint64_t> _quanta_captured { 0 };
+    std::atomic<uint64_t> _quanta_suppressed { 0 };
+    std::atomic<uint64_t> _segments_sent { 0 };
+    std::atomic<uint64_t> _send_errors { 0 };
+    std::atomic<uint64_t> _queue_drops { 0 };
+    std::atomic<uint64_t> _peer_reported_loss { 0 };  // Downstream loss from cmd_heartbeat_stats reports
+    std::atomic<uint64_t> _device_period_us { 0 };  // Achieved capture device period, set once at stream start
+    latency_histogram _capture_to_send_us;
+};
+
+} // namespace audio_share
+
+#endif // METRICS_HPP
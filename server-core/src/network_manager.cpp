@@ -1,522 +1,2134 @@
-/*
-   Copyright 2022-2024 mkckr0 <https://github.com/mkckr0>
-
-   Licensed under the Apache License, Version 2.0 (the "License");
-   you may not use this file except in compliance with the License.
-   You may obtain a copy of the License at
-
-       http://www.apache.org/licenses/LICENSE-2.0
-
-   Unless required by applicable law or agreed to in writing, software
-   distributed under the License is distributed on an "AS IS" BASIS,
-   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
-   See the License for the specific language governing permissions and
-   limitations under the License.
-*/
-
-#include "network_manager.hpp"
-#include "formatter.hpp"
-#include "audio_manager.hpp"
-#include "constants.hpp"
-
-#include <list>
-#include <ranges>
-#include <coroutine>
-#include <memory>
-#include <set>
-
-#ifdef _WINDOWS
-#include <iphlpapi.h>
-#include <winsock2.h>
-#include <ws2tcpip.h>
-#pragma comment(lib, "Ws2_32.lib")
-#pragma comment(lib, "Iphlpapi.lib")
-#endif // _WINDOWS
-
-#ifdef linux
-#include <sys/types.h>
-#include <ifaddrs.h>
-#endif
-
-#include <spdlog/spdlog.h>
-#include <fmt/ranges.h>
-
-namespace ip = asio::ip;
-using namespace std::chrono_literals;
-using namespace audio_share::constants;
-
-network_manager::network_manager(std::shared_ptr<audio_manager>& audio_manager)
-    : _audio_manager(audio_manager)
-    , _buffer_pool(std::make_unique<audio_share::buffer_pool>(MAX_UDP_PAYLOAD_SIZE, 16, 128))
-{
-}
-
-std::vector<std::string> network_manager::get_address_list()
-{
-    std::vector<std::string> address_list;
-
-#ifdef _WINDOWS
-    ULONG family = AF_INET;
-    ULONG flags = GAA_FLAG_INCLUDE_ALL_INTERFACES;
-
-    // First call to get required buffer size
-    ULONG size = 0;
-    ULONG ret = GetAdaptersAddresses(family, flags, nullptr, nullptr, &size);
-    if (ret != ERROR_BUFFER_OVERFLOW) {
-        spdlog::warn("GetAdaptersAddresses failed to get buffer size, error: {}", ret);
-        return address_list;
-    }
-
-    // RAII wrapper for adapter addresses memory
-    auto addresses_deleter = [](IP_ADAPTER_ADDRESSES* p) { free(p); };
-    std::unique_ptr<IP_ADAPTER_ADDRESSES, decltype(addresses_deleter)> pAddresses(
-        static_cast<PIP_ADAPTER_ADDRESSES>(malloc(size)), addresses_deleter);
-    
-    if (!pAddresses) {
-        spdlog::error("Failed to allocate memory for adapter addresses");
-        return address_list;
-    }
-
-    ret = GetAdaptersAddresses(family, flags, nullptr, pAddresses.get(), &size);
-    if (ret != ERROR_SUCCESS) {
-        spdlog::warn("GetAdaptersAddresses failed, error: {}", ret);
-        return address_list;
-    }
-
-    for (auto pCurrentAddress = pAddresses.get(); pCurrentAddress; pCurrentAddress = pCurrentAddress->Next) {
-        if (pCurrentAddress->OperStatus != IfOperStatusUp || pCurrentAddress->IfType == IF_TYPE_SOFTWARE_LOOPBACK) {
-            continue;
-        }
-
-        for (auto pUnicast = pCurrentAddress->FirstUnicastAddress; pUnicast; pUnicast = pUnicast->Next) {
-            auto sockaddr = reinterpret_cast<sockaddr_in*>(pUnicast->Address.lpSockaddr);
-            char buf[INET_ADDRSTRLEN];
-            if (inet_ntop(AF_INET, &sockaddr->sin_addr, buf, sizeof(buf))) {
-                address_list.emplace_back(buf);
-            }
-        }
-    }
-#endif
-
-#ifdef linux
-    struct ifaddrs* ifaddrs_raw = nullptr;
-    if (getifaddrs(&ifaddrs_raw) == -1) {
-        spdlog::warn("getifaddrs failed");
-        return address_list;
-    }
-
-    // RAII wrapper for ifaddrs
-    auto ifaddrs_deleter = [](struct ifaddrs* p) { freeifaddrs(p); };
-    std::unique_ptr<struct ifaddrs, decltype(ifaddrs_deleter)> ifaddrs(ifaddrs_raw, ifaddrs_deleter);
-
-    for (auto ifa = ifaddrs.get(); ifa; ifa = ifa->ifa_next) {
-        if (!ifa->ifa_addr) {
-            continue;
-        }
-        if (ifa->ifa_addr->sa_family != AF_INET) {
-            continue;
-        }
-        if (ifa->ifa_flags & IFF_LOOPBACK) {
-            continue;
-        }
-        auto sockaddr = reinterpret_cast<sockaddr_in*>(ifa->ifa_addr);
-        char buf[INET_ADDRSTRLEN];
-        if (inet_ntop(AF_INET, &sockaddr->sin_addr, buf, sizeof(buf))) {
-            address_list.emplace_back(buf);
-        }
-    }
-#endif
-
-    return address_list;
-}
-
-std::string network_manager::get_default_address()
-{
-    return select_default_address(get_address_list());
-}
-
-std::string network_manager::select_default_address(const std::vector<std::string>& address_list)
-{
-    if (address_list.empty()) {
-        return {};
-    }
-
-    auto is_private_address = [](const std::string& address) {
-        constexpr uint32_t private_addr_list[] = {
-            0x0a000000,
-            0xac100000,
-            0xc0a80000,
-        };
-
-        uint32_t addr;
-        inet_pton(AF_INET, address.c_str(), &addr);
-        addr = ntohl(addr);
-        for (auto&& private_addr : private_addr_list) {
-            if ((addr & private_addr) == private_addr) {
-                return true;
-            }
-        }
-
-        return false;
-    };
-
-    for (auto&& address : address_list) {
-        if (is_private_address(address)) {
-            return address;
-        }
-    }
-    return address_list.front();
-}
-
-void network_manager::start_server(const std::string& host, uint16_t port, const audio_manager::capture_config& capture_config)
-{
-    _ioc = std::make_shared<asio::io_context>();
-    {
-        ip::tcp::endpoint endpoint { ip::make_address(host), port };
-
-        ip::tcp::acceptor acceptor(*_ioc, endpoint.protocol());
-        acceptor.set_option(ip::tcp::acceptor::reuse_address(true));
-        acceptor.bind(endpoint);
-        acceptor.listen();
-
-        _audio_manager->start_loopback_recording(shared_from_this(), capture_config);
-        asio::co_spawn(*_ioc, accept_tcp_loop(std::move(acceptor)), asio::detached);
-
-        // start tcp success
-        spdlog::info("tcp listen success on {}", endpoint);
-    }
-
-    {
-        ip::udp::endpoint endpoint { ip::make_address(host), port };
-        _udp_server = std::make_unique<udp_socket>(*_ioc, endpoint.protocol());
-        _udp_server->bind(endpoint);
-        asio::co_spawn(*_ioc, accept_udp_loop(), asio::detached);
-
-        // start udp success
-        spdlog::info("udp listen success on {}", endpoint);
-    }
-
-    _net_thread = std::thread([self = shared_from_this()] {
-        self->_ioc->run();
-    });
-
-    spdlog::info("server started");
-}
-
-void network_manager::stop_server()
-{
-    if (_ioc) {
-        _ioc->stop();
-    }
-    _net_thread.join();
-    _audio_manager->stop();
-    _playing_peer_list.clear();
-    _udp_server = nullptr;
-    _ioc = nullptr;
-    spdlog::info("server stopped");
-}
-
-void network_manager::wait_server()
-{
-    _net_thread.join();
-}
-
-bool network_manager::is_running() const
-{
-    return _ioc != nullptr;
-}
-
-asio::awaitable<void> network_manager::read_loop(std::shared_ptr<tcp_socket> peer)
-{
-    while (true) {
-        cmd_t cmd = cmd_t::cmd_none;
-        auto [ec, _] = co_await asio::async_read(*peer, asio::buffer(&cmd, sizeof(cmd)));
-        if (ec) {
-            close_session(peer);
-            spdlog::trace("{} {}", __func__, ec);
-            break;
-        }
-
-        spdlog::trace("cmd {}", (uint32_t)cmd);
-
-        if (cmd == cmd_t::cmd_get_format) {
-            auto format = _audio_manager->get_format_binary();
-            auto size = (uint32_t)format.size();
-            std::array<asio::const_buffer, 3> buffers = {
-                asio::buffer(&cmd, sizeof(cmd)),
-                asio::buffer(&size, sizeof(size)),
-                asio::buffer(format),
-            };
-            auto [ec, _] = co_await asio::async_write(*peer, buffers);
-            if (ec) {
-                close_session(peer);
-                spdlog::trace("{} {}", __func__, ec);
-                break;
-            }
-        } else if (cmd == cmd_t::cmd_start_play) {
-            int id = add_playing_peer(peer);
-            if (id <= 0) {
-                spdlog::error("{} id error", __func__);
-                close_session(peer);
-                spdlog::trace("{} {}", __func__, ec);
-                break;
-            }
-            std::array<asio::const_buffer, 2> buffers = {
-                asio::buffer(&cmd, sizeof(cmd)),
-                asio::buffer(&id, sizeof(id)),
-            };
-            auto [ec, _] = co_await asio::async_write(*peer, buffers);
-            if (ec) {
-                spdlog::trace("{} {}", __func__, ec);
-                close_session(peer);
-                break;
-            }
-            asio::co_spawn(*_ioc, heartbeat_loop(peer), asio::detached);
-        } else if (cmd == cmd_t::cmd_heartbeat) {
-            std::lock_guard<std::mutex> lock(_peer_list_mutex);
-            auto it = _playing_peer_list.find(peer);
-            if (it != _playing_peer_list.end()) {
-                it->second->last_tick.store(std::chrono::steady_clock::now());
-            }
-        } else {
-            spdlog::error("{} error cmd", __func__);
-            close_session(peer);
-            break;
-        }
-    }
-    spdlog::trace("stop {}", __func__);
-}
-
-asio::awaitable<void> network_manager::heartbeat_loop(std::shared_ptr<tcp_socket> peer)
-{
-    std::error_code ec;
-    size_t _;
-
-    steady_timer timer(*_ioc);
-    while (true) {
-        timer.expires_after(HEARTBEAT_INTERVAL);
-        std::tie(ec) = co_await timer.async_wait();
-        if (ec) {
-            break;
-        }
-
-        if (!peer->is_open()) {
-            break;
-        }
-
-        // Check peer status with thread-safe access
-        bool should_close = false;
-        bool peer_not_found = false;
-        {
-            std::lock_guard<std::mutex> lock(_peer_list_mutex);
-            auto it = _playing_peer_list.find(peer);
-            if (it == _playing_peer_list.end()) {
-                spdlog::trace("{} it == _playing_peer_list.end()", __func__);
-                peer_not_found = true;
-            } else if (std::chrono::steady_clock::now() - it->second->last_tick.load() > _heartbeat_timeout) {
-                spdlog::info("{} timeout", it->first->remote_endpoint());
-                should_close = true;
-            }
-        }
-
-        if (peer_not_found || should_close) {
-            close_session(peer);
-            break;
-        }
-
-        auto cmd = cmd_t::cmd_heartbeat;
-        std::tie(ec, _) = co_await asio::async_write(*peer, asio::buffer(&cmd, sizeof(cmd)));
-        if (ec) {
-            spdlog::trace("{} {}", __func__, ec);
-            close_session(peer);
-            break;
-        }
-    }
-    spdlog::trace("stop {}", __func__);
-}
-
-asio::awaitable<void> network_manager::accept_tcp_loop(tcp_acceptor acceptor)
-{
-    while (true) {
-        auto peer = std::make_shared<tcp_socket>(acceptor.get_executor());
-        auto [ec] = co_await acceptor.async_accept(*peer);
-        if (ec) {
-            spdlog::error("{} {}", __func__, ec);
-            co_return;
-        }
-
-        spdlog::info("accept {}", peer->remote_endpoint());
-
-        // No-Delay
-        peer->set_option(ip::tcp::no_delay(true), ec);
-        if (ec) {
-            spdlog::info("{} {}", __func__, ec);
-        }
-
-        asio::co_spawn(acceptor.get_executor(), read_loop(peer), asio::detached);
-    }
-}
-
-asio::awaitable<void> network_manager::accept_udp_loop()
-{
-    while (true) {
-        int id = 0;
-        ip::udp::endpoint udp_peer;
-        auto [ec, _] = co_await _udp_server->async_receive_from(asio::buffer(&id, sizeof(id)), udp_peer);
-        if (ec) {
-            spdlog::info("{} {}", __func__, ec);
-            co_return;
-        }
-
-        fill_udp_peer(id, udp_peer);
-    }
-}
-
-auto network_manager::close_session(std::shared_ptr<tcp_socket>& peer) -> playing_peer_list_t::iterator
-{
-    spdlog::info("close {}", peer->remote_endpoint());
-    auto it = remove_playing_peer(peer);
-    peer->shutdown(ip::tcp::socket::shutdown_both);
-    peer->close();
-    return it;
-}
-
-int network_manager::add_playing_peer(std::shared_ptr<tcp_socket>& peer)
-{
-    std::lock_guard<std::mutex> lock(_peer_list_mutex);
-    if (_playing_peer_list.contains(peer)) {
-        spdlog::error("{} repeat add tcp://{}", __func__, peer->remote_endpoint());
-        return 0;
-    }
-
-    auto info = _playing_peer_list[peer] = std::make_shared<peer_info_t>();
-    static int g_id = 0;
-    info->id = ++g_id;
-    info->last_tick.store(std::chrono::steady_clock::now());
-
-    spdlog::trace("{} add id:{} tcp://{}", __func__, info->id, peer->remote_endpoint());
-    return info->id;
-}
-
-auto network_manager::remove_playing_peer(std::shared_ptr<tcp_socket>& peer) -> playing_peer_list_t::iterator
-{
-    std::lock_guard<std::mutex> lock(_peer_list_mutex);
-    auto it = _playing_peer_list.find(peer);
-    if (it == _playing_peer_list.end()) {
-        spdlog::error("{} repeat remove tcp://{}", __func__, peer->remote_endpoint());
-        return it;
-    }
-
-    it = _playing_peer_list.erase(it);
-    spdlog::trace("{} remove tcp://{}", __func__, peer->remote_endpoint());
-    return it;
-}
-
-void network_manager::fill_udp_peer(int id, asio::ip::udp::endpoint udp_peer)
-{
-    std::lock_guard<std::mutex> lock(_peer_list_mutex);
-    auto it = std::find_if(_playing_peer_list.begin(), _playing_peer_list.end(), [id](const playing_peer_list_t::value_type& e) {
-        return e.second->id == id;
-    });
-
-    if (it == _playing_peer_list.cend()) {
-        spdlog::error("{} no tcp peer id:{} udp://{}", __func__, id, udp_peer);
-        return;
-    }
-
-    // Handle IPv4-mapped IPv6 addresses (::ffff:x.x.x.x)
-    // If the UDP server is IPv4 but client sends from IPv6-mapped address, extract the IPv4 part
-    auto address = udp_peer.address();
-    if (address.is_v6()) {
-        auto v6_addr = address.to_v6();
-        if (v6_addr.is_v4_mapped()) {
-            // Convert IPv4-mapped IPv6 address to IPv4
-            auto v4_addr = asio::ip::make_address_v4(asio::ip::v4_mapped, v6_addr);
-            udp_peer = ip::udp::endpoint(v4_addr, udp_peer.port());
-            spdlog::debug("{} converted IPv4-mapped IPv6 to IPv4: {}", __func__, udp_peer);
-        }
-    }
-
-    it->second->udp_peer = udp_peer;
-    spdlog::info("{} fill udp peer id:{} tcp://{} udp://{}", __func__, id, it->first->remote_endpoint(), udp_peer);
-}
-
-void network_manager::broadcast_audio_data(const char* data, size_t count, int block_align)
-{
-    if (count <= 0) {
-        return;
-    }
-    // spdlog::trace("broadcast_audio_data count: {}", count);
-
-    // Forward to additional broadcasters (e.g., WebSocket)
-    {
-        std::lock_guard<std::mutex> lock(_broadcasters_mutex);
-        for (const auto& broadcaster : _additional_broadcasters) {
-            if (broadcaster) {
-                broadcaster->broadcast_audio_data(data, count, block_align);
-            }
-        }
-    }
-
-    // divide udp frame using constants
-    int max_seg_size = MAX_UDP_PAYLOAD_SIZE;
-    max_seg_size -= max_seg_size % block_align; // one single sample can't be divided
-
-    // Use buffer pool for reduced allocation overhead
-    std::vector<audio_share::buffer_pool::buffer_ptr> seg_list;
-    seg_list.reserve((count + max_seg_size - 1) / max_seg_size);
-
-    for (size_t begin_pos = 0; begin_pos < count;) {
-        const size_t real_seg_size = std::min(count - begin_pos, static_cast<size_t>(max_seg_size));
-        auto seg = _buffer_pool->acquire();
-        seg->resize(real_seg_size);
-        std::copy((const uint8_t*)data + begin_pos, (const uint8_t*)data + begin_pos + real_seg_size, seg->begin());
-        seg_list.push_back(std::move(seg));
-        begin_pos += real_seg_size;
-    }
-
-    // Create a thread-safe copy of UDP endpoints
-    // Filter out endpoints with incompatible address families
-    std::vector<asio::ip::udp::endpoint> udp_peers;
-    {
-        std::lock_guard<std::mutex> lock(_peer_list_mutex);
-        udp_peers.reserve(_playing_peer_list.size());
-        bool is_server_v4 = _udp_server->local_endpoint().address().is_v4();
-        for (const auto& [peer, info] : _playing_peer_list) {
-            const auto& udp_ep = info->udp_peer;
-            // Check address family compatibility
-            if ((is_server_v4 && udp_ep.address().is_v4()) ||
-                (!is_server_v4 && udp_ep.address().is_v6())) {
-                udp_peers.push_back(udp_ep);
-            } else {
-                // Log mismatch only once per session (avoid spamming)
-                static std::set<int> logged_ids;
-                if (logged_ids.find(info->id) == logged_ids.end()) {
-                    spdlog::warn("Address family mismatch for peer id:{} - server is {}, client UDP is {}",
-                        info->id, is_server_v4 ? "IPv4" : "IPv6", 
-                        udp_ep.address().is_v4() ? "IPv4" : "IPv6");
-                    logged_ids.insert(info->id);
-                }
-            }
-        }
-    }
-
-    _ioc->post([seg_list = std::move(seg_list), udp_peers = std::move(udp_peers), self = shared_from_this()] {
-        for (const auto& seg : seg_list) {
-            for (const auto& udp_peer : udp_peers) {
-                self->_udp_server->async_send_to(asio::buffer(*seg), udp_peer, [seg](const asio::error_code& ec, std::size_t bytes_transferred) { 
-                    if (ec) {
-                        spdlog::trace("UDP send error: {}", ec.message());
-                    }
-                });
-            }
-        }
-    });
-}
-
-void network_manager::add_broadcaster(std::shared_ptr<audio_broadcaster> broadcaster)
-{
-    std::lock_guard<std::mutex> lock(_broadcasters_mutex);
-    _additional_broadcasters.push_back(broadcaster);
-    spdlog::info("Added additional broadcaster, total: {}", _additional_broadcasters.size());
-}
+/*
+   Copyright 2022-2024 mkckr0 <https://github.com/mkckr0>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "network_manager.hpp"
+#include "formatter.hpp"
+#include "logging.hpp"
+#include "metrics.hpp"
+#include "sample_converter.hpp"
+#include "audio_manager.hpp"
+#include "constants.hpp"
+
+#include <algorithm>
+#include <list>
+#include <random>
+#include <ranges>
+#include <coroutine>
+#include <cstring>
+#include <memory>
+
+#ifdef _WINDOWS
+#include <iphlpapi.h>
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#pragma comment(lib, "Iphlpapi.lib")
+#endif // _WINDOWS
+
+#ifdef linux
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <ifaddrs.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+#include <spdlog/spdlog.h>
+#include <fmt/ranges.h>
+
+namespace ip = asio::ip;
+using namespace std::chrono_literals;
+using namespace audio_share::constants;
+
+network_manager::network_manager(std::shared_ptr<audio_manager>& audio_manager)
+    : _audio_manager(audio_manager)
+    , _slab_pool(std::make_unique<audio_share::buffer_pool>(CAPTURE_SLAB_SIZE, 8, 32))
+{
+}
+
+std::vector<std::string> network_manager::get_address_list()
+{
+    std::vector<std::string> address_list;
+
+#ifdef _WINDOWS
+    ULONG family = AF_INET;
+    ULONG flags = GAA_FLAG_INCLUDE_ALL_INTERFACES;
+
+    // First call to get required buffer size
+    ULONG size = 0;
+    ULONG ret = GetAdaptersAddresses(family, flags, nullptr, nullptr, &size);
+    if (ret != ERROR_BUFFER_OVERFLOW) {
+        spdlog::warn("GetAdaptersAddresses failed to get buffer size, error: {}", ret);
+        return address_list;
+    }
+
+    // RAII wrapper for adapter addresses memory
+    auto addresses_deleter = [](IP_ADAPTER_ADDRESSES* p) { free(p); };
+    std::unique_ptr<IP_ADAPTER_ADDRESSES, decltype(addresses_deleter)> pAddresses(
+        static_cast<PIP_ADAPTER_ADDRESSES>(malloc(size)), addresses_deleter);
+    
+    if (!pAddresses) {
+        spdlog::error("Failed to allocate memory for adapter addresses");
+        return address_list;
+    }
+
+    ret = GetAdaptersAddresses(family, flags, nullptr, pAddresses.get(), &size);
+    if (ret != ERROR_SUCCESS) {
+        spdlog::warn("GetAdaptersAddresses failed, error: {}", ret);
+        return address_list;
+    }
+
+    for (auto pCurrentAddress = pAddresses.get(); pCurrentAddress; pCurrentAddress = pCurrentAddress->Next) {
+        if (pCurrentAddress->OperStatus != IfOperStatusUp || pCurrentAddress->IfType == IF_TYPE_SOFTWARE_LOOPBACK) {
+            continue;
+        }
+
+        for (auto pUnicast = pCurrentAddress->FirstUnicastAddress; pUnicast; pUnicast = pUnicast->Next) {
+            auto sockaddr = reinterpret_cast<sockaddr_in*>(pUnicast->Address.lpSockaddr);
+            char buf[INET_ADDRSTRLEN];
+            if (inet_ntop(AF_INET, &sockaddr->sin_addr, buf, sizeof(buf))) {
+                address_list.emplace_back(buf);
+            }
+        }
+    }
+#endif
+
+#ifdef linux
+    struct ifaddrs* ifaddrs_raw = nullptr;
+    if (getifaddrs(&ifaddrs_raw) == -1) {
+        spdlog::warn("getifaddrs failed");
+        return address_list;
+    }
+
+    // RAII wrapper for ifaddrs
+    auto ifaddrs_deleter = [](struct ifaddrs* p) { freeifaddrs(p); };
+    std::unique_ptr<struct ifaddrs, decltype(ifaddrs_deleter)> ifaddrs(ifaddrs_raw, ifaddrs_deleter);
+
+    for (auto ifa = ifaddrs.get(); ifa; ifa = ifa->ifa_next) {
+        if (!ifa->ifa_addr) {
+            continue;
+        }
+        if (ifa->ifa_addr->sa_family != AF_INET) {
+            continue;
+        }
+        if (ifa->ifa_flags & IFF_LOOPBACK) {
+            continue;
+        }
+        auto sockaddr = reinterpret_cast<sockaddr_in*>(ifa->ifa_addr);
+        char buf[INET_ADDRSTRLEN];
+        if (inet_ntop(AF_INET, &sockaddr->sin_addr, buf, sizeof(buf))) {
+            address_list.emplace_back(buf);
+        }
+    }
+#endif
+
+    return address_list;
+}
+
+std::string network_manager::get_default_address()
+{
+    return select_default_address(get_address_list());
+}
+
+std::string network_manager::select_default_address(const std::vector<std::string>& address_list)
+{
+    if (address_list.empty()) {
+        return {};
+    }
+
+    auto is_private_address = [](const std::string& address) {
+        constexpr uint32_t private_addr_list[] = {
+            0x0a000000,
+            0xac100000,
+            0xc0a80000,
+        };
+
+        uint32_t addr;
+        inet_pton(AF_INET, address.c_str(), &addr);
+        addr = ntohl(addr);
+        for (auto&& private_addr : private_addr_list) {
+            if ((addr & private_addr) == private_addr) {
+                return true;
+            }
+        }
+
+        return false;
+    };
+
+    for (auto&& address : address_list) {
+        if (is_private_address(address)) {
+            return address;
+        }
+    }
+    return address_list.front();
+}
+
+void network_manager::set_multicast(const std::string& group, uint16_t port)
+{
+    std::error_code ec;
+    auto address = ip::make_address_v4(group, ec);
+    if (ec || !address.is_multicast()) {
+        spdlog::error("{} \"{}\" is not a valid IPv4 multicast group", __func__, group);
+        return;
+    }
+    _multicast_group = address;
+    _multicast_port = port;
+}
+
+void network_manager::start_server(const std::string& host, uint16_t port, const audio_manager::capture_config& capture_config)
+{
+    _ioc = std::make_shared<asio::io_context>();
+    _broadcast_strand = std::make_unique<asio::strand<asio::io_context::executor_type>>(asio::make_strand(*_ioc));
+    {
+        ip::tcp::endpoint endpoint { ip::make_address(host), port };
+
+        ip::tcp::acceptor acceptor(*_ioc, endpoint.protocol());
+        acceptor.set_option(ip::tcp::acceptor::reuse_address(true));
+        acceptor.bind(endpoint);
+        acceptor.listen();
+
+        _audio_manager->start_loopback_recording(shared_from_this(), capture_config);
+        asio::co_spawn(*_ioc, accept_tcp_loop(std::move(acceptor)), asio::detached);
+
+        // start tcp success
+        spdlog::info("tcp listen success on {}", endpoint);
+    }
+
+    {
+        // The UDP server is one dual-stack v6 socket: v4 peers are stored in
+        // v4-mapped form at registration and share the socket, so the
+        // broadcast side never filters targets by address family. A specific
+        // v4 host address binds as its v4-mapped form; the unspecified v4
+        // address binds as :: to cover both families.
+        const auto host_address = ip::make_address(host);
+        ip::udp::endpoint endpoint { host_address, port };
+        if (host_address.is_v4()) {
+            auto v4 = host_address.to_v4();
+            endpoint = ip::udp::endpoint(v4 == ip::address_v4::any()
+                    ? ip::address_v6::any()
+                    : ip::make_address_v6(ip::v4_mapped, v4),
+                port);
+        }
+        _udp_server = std::make_unique<udp_socket>(*_ioc, ip::udp::v6());
+        std::error_code opt_ec;
+        _udp_server->set_option(ip::v6_only(false), opt_ec);
+        if (opt_ec) {
+            spdlog::warn("dual-stack udp unavailable: {}", opt_ec.message());
+        }
+        _udp_server->bind(endpoint);
+        // Send buffer, DSCP marking and busy-poll, each logged with the
+        // value the host actually granted
+        _socket_tuner = std::make_unique<audio_share::socket_tuner>(_tuning_config);
+        _socket_tuner->tune_udp_server((uintptr_t)_udp_server->native_handle());
+        // UDP registration shares the socket with the broadcast sends, keep
+        // them on the same strand
+        asio::co_spawn(*_broadcast_strand, accept_udp_loop(), asio::detached);
+
+        // start udp success
+        spdlog::info("udp listen success on {}", endpoint);
+
+#ifdef AUDIO_SHARE_HAS_URING
+        // Runtime selection: keep the sendmmsg path on kernels without
+        // io_uring
+        _uring_sender = std::make_unique<audio_share::uring_sender>(_udp_server->native_handle());
+        if (!_uring_sender->valid()) {
+            _uring_sender.reset();
+        }
+#endif
+
+        if (!_multicast_group.is_unspecified()) {
+            std::error_code ec;
+            // hops maps to IPV6_MULTICAST_HOPS on the dual-stack socket;
+            // the v4 group traffic is governed by IP_MULTICAST_TTL, which
+            // asio cannot express on a v6 socket, so set it directly or the
+            // kernel default of 1 quietly caps the stream to one hop
+            _udp_server->set_option(ip::multicast::hops(MULTICAST_TTL), ec);
+            int ttl = MULTICAST_TTL;
+#ifdef _WINDOWS
+            ::setsockopt((SOCKET)_udp_server->native_handle(), IPPROTO_IP, IP_MULTICAST_TTL, (const char*)&ttl, sizeof(ttl));
+#else
+            ::setsockopt(_udp_server->native_handle(), IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+#endif
+            if (host_address.is_v4() && host_address.to_v4() != ip::address_v4::any()) {
+                // v4 options apply to the v4 half of the dual-stack socket
+                _udp_server->set_option(ip::multicast::outbound_interface(host_address.to_v4()), ec);
+            }
+            spdlog::info("multicast mode on {}:{}", _multicast_group.to_string(), _multicast_port);
+        }
+    }
+
+    // Always-on flight recorder; only written on the broadcast strand
+    _recorder = std::make_unique<audio_share::flight_recorder>(RECORDER_RING_CAPACITY);
+    if (!_recorder->valid()) {
+        _recorder.reset();
+    }
+#ifdef linux
+    if (_recorder) {
+        asio::co_spawn(*_broadcast_strand, dump_signal_loop(), asio::detached);
+    }
+#endif
+
+    // Single timer driving the transmit pacer; it lives on the broadcast
+    // strand with everything else that touches the UDP socket
+    _pace_timer = std::make_unique<steady_timer>(*_broadcast_strand);
+
+    // One timer sweeps every playing peer's heartbeat state per interval
+    _heartbeat_timer = std::make_unique<steady_timer>(*_ioc);
+    asio::co_spawn(*_ioc, heartbeat_sweep_loop(), asio::detached);
+
+    int thread_count = _net_thread_count;
+    if (thread_count <= 0) {
+        thread_count = std::min(4u, std::max(1u, std::thread::hardware_concurrency()));
+    }
+    _net_threads.reserve(thread_count);
+    for (int i = 0; i < thread_count; ++i) {
+        _net_threads.emplace_back([self = shared_from_this()] {
+            self->_ioc->run();
+        });
+    }
+
+    spdlog::info("server started with {} net threads", thread_count);
+}
+
+void network_manager::stop_server()
+{
+    if (_ioc) {
+        _ioc->stop();
+    }
+    for (auto& thread : _net_threads) {
+        thread.join();
+    }
+    _net_threads.clear();
+    _audio_manager->stop();
+    _heartbeat_timer = nullptr;
+    _pace_timer = nullptr;
+    _pace_queue.clear();
+    _playing_peer_list.clear();
+    _peer_index.clear();
+    _v2_streams.clear();
+    _resamplers.clear();
+    _seg_plans.clear();
+    _resume_cache.clear();
+    _peer_snapshot.store(nullptr, std::memory_order_release);
+#ifdef AUDIO_SHARE_HAS_URING
+    _uring_sender = nullptr;  // Drains in-flight sends before the socket goes away
+#endif
+    _udp_server = nullptr;
+    _socket_tuner = nullptr;
+    _shm = nullptr;
+    _recorder = nullptr;
+    _broadcast_strand = nullptr;
+    _ioc = nullptr;
+    spdlog::info("server stopped");
+}
+
+void network_manager::wait_server()
+{
+    for (auto& thread : _net_threads) {
+        thread.join();
+    }
+}
+
+bool network_manager::is_running() const
+{
+    return _ioc != nullptr;
+}
+
+asio::awaitable<void> network_manager::read_loop(std::shared_ptr<tcp_socket> peer)
+{
+    while (true) {
+        cmd_t cmd = cmd_t::cmd_none;
+        auto [ec, _] = co_await asio::async_read(*peer, asio::buffer(&cmd, sizeof(cmd)));
+        if (ec) {
+            close_session(peer);
+            spdlog::trace("{} {}", __func__, ec);
+            break;
+        }
+
+        // The top bits of the cmd word carry capability flags; mask them off
+        // before dispatching so flag-less clients are unaffected
+        const uint32_t cmd_flags = (uint32_t)cmd & CMD_FLAG_MASK;
+        cmd = (cmd_t)((uint32_t)cmd & ~CMD_FLAG_MASK);
+
+        AUDIO_SHARE_LOG_EVERY_MS(spdlog::level::trace, 1000, "cmd {}", (uint32_t)cmd);
+
+        if (cmd == cmd_t::cmd_get_format) {
+            // Reflect this peer's granted per-connection rate, if any
+            int resample_rate = 0;
+            {
+                std::lock_guard<std::mutex> lock(_peer_list_mutex);
+                auto it = _playing_peer_list.find(peer);
+                if (it != _playing_peer_list.end()) {
+                    resample_rate = it->second->sample_rate;
+                }
+            }
+            if (cmd_flags & CMD_FLAG_COMPACT_FORMAT) {
+                // Embedded clients built without protobuf get the same
+                // fields as a fixed 16-byte struct, and the server skips the
+                // serialize. The values are read straight off the shared
+                // AudioFormat, and the numbering is pinned at compile time,
+                // so the two replies describe one stream by construction.
+                using pb_format = audio_manager::AudioFormat;
+                static_assert(pb_format::ENCODING_INVALID == 0
+                        && pb_format::ENCODING_PCM_FLOAT == 1
+                        && pb_format::ENCODING_PCM_8BIT == 2
+                        && pb_format::ENCODING_PCM_16BIT == 3
+                        && pb_format::ENCODING_PCM_24BIT == 4
+                        && pb_format::ENCODING_PCM_32BIT == 5,
+                    "wire_format_t relies on the AudioFormat encoding numbering");
+
+                const auto& format = _audio_manager->get_format();
+                wire_format_t wire {};
+                wire.version = 2;  // Matches the protobuf's protocol_version
+                wire.encoding = (uint16_t)format->encoding();
+                wire.channels = (uint16_t)format->channels();
+                wire.sample_rate = (uint32_t)format->sample_rate();
+                wire.resample_rate = (uint32_t)resample_rate;
+                int sample_bytes = 0;
+                switch (format->encoding()) {
+                case pb_format::ENCODING_PCM_8BIT:
+                    sample_bytes = 1;
+                    break;
+                case pb_format::ENCODING_PCM_16BIT:
+                    sample_bytes = 2;
+                    break;
+                case pb_format::ENCODING_PCM_24BIT:
+                    sample_bytes = 3;
+                    break;
+                case pb_format::ENCODING_PCM_FLOAT:
+                case pb_format::ENCODING_PCM_32BIT:
+                    sample_bytes = 4;
+                    break;
+                default:
+                    break;
+                }
+                wire.block_align = (uint16_t)(sample_bytes * format->channels());
+
+                uint32_t reply_cmd = (uint32_t)cmd | CMD_FLAG_COMPACT_FORMAT;
+                uint32_t size = (uint32_t)sizeof(wire);
+                std::array<asio::const_buffer, 3> buffers = {
+                    asio::buffer(&reply_cmd, sizeof(reply_cmd)),
+                    asio::buffer(&size, sizeof(size)),
+                    asio::buffer(&wire, sizeof(wire)),
+                };
+                auto [ec, _] = co_await asio::async_write(*peer, buffers);
+                if (ec) {
+                    close_session(peer);
+                    spdlog::trace("{} {}", __func__, ec);
+                    break;
+                }
+            } else {
+                auto format = _audio_manager->get_format_binary(resample_rate);
+                auto size = (uint32_t)format.size();
+                std::array<asio::const_buffer, 3> buffers = {
+                    asio::buffer(&cmd, sizeof(cmd)),
+                    asio::buffer(&size, sizeof(size)),
+                    asio::buffer(format),
+                };
+                auto [ec, _] = co_await asio::async_write(*peer, buffers);
+                if (ec) {
+                    close_session(peer);
+                    spdlog::trace("{} {}", __func__, ec);
+                    break;
+                }
+            }
+        } else if (cmd == cmd_t::cmd_start_play) {
+            // Grant multicast only when the client asked for it and the mode
+            // is configured; everyone else stays on unicast. The group stream
+            // is shared by v1 listeners, so multicast peers stay on v1 frames.
+            // Same-host peers can skip the UDP stack entirely: grant shm only
+            // when the control connection really is loopback, and create the
+            // region before the peer is published so the broadcast side sees
+            // a fully constructed ring
+            bool use_shm = (cmd_flags & CMD_FLAG_SHM) != 0;
+            if (use_shm) {
+                std::error_code ep_ec;
+                auto remote = peer->remote_endpoint(ep_ec);
+                use_shm = !ep_ec && remote.address().is_loopback();
+            }
+            if (use_shm) {
+                // Two loopback peers can negotiate concurrently from
+                // different strands; create-once under the peer list mutex
+                std::lock_guard<std::mutex> lock(_peer_list_mutex);
+                if (!_shm) {
+                    _shm = std::make_unique<audio_share::shm_transport>(SHM_RING_CAPACITY);
+                }
+                if (!_shm->valid()) {
+                    use_shm = false;
+                }
+            }
+            // An shm peer needs no UDP transport features
+            const bool use_multicast = !use_shm && (cmd_flags & CMD_FLAG_MULTICAST) && !_multicast_group.is_unspecified();
+            const bool use_frame_v2 = (cmd_flags & CMD_FLAG_FRAME_V2) && !use_multicast && !use_shm;
+            // FEC rides on the v2 framing; the client appends its requested
+            // parity group size K to the request
+            uint16_t fec_k = 0;
+            if (cmd_flags & CMD_FLAG_FEC) {
+                uint32_t requested_k = 0;
+                auto [k_ec, k_n] = co_await asio::async_read(*peer, asio::buffer(&requested_k, sizeof(requested_k)));
+                if (k_ec) {
+                    close_session(peer);
+                    spdlog::trace("{} {}", __func__, k_ec);
+                    break;
+                }
+                if (use_frame_v2 && requested_k >= FEC_MIN_K && requested_k <= FEC_MAX_K) {
+                    fec_k = (uint16_t)requested_k;
+                }
+            }
+            int id = add_playing_peer(peer, use_multicast, use_frame_v2, fec_k, use_shm, co_await asio::this_coro::executor);
+            if (id <= 0) {
+                spdlog::error("{} id error", __func__);
+                close_session(peer);
+                spdlog::trace("{} {}", __func__, ec);
+                break;
+            }
+            // Fast resume: hand out a session token so a roaming client can
+            // restore this negotiated state with cmd_resume_play instead of
+            // repeating the whole handshake
+            uint64_t session_token = 0;
+            if (cmd_flags & CMD_FLAG_RESUME) {
+                std::lock_guard<std::mutex> lock(_peer_list_mutex);
+                auto pit = _playing_peer_list.find(peer);
+                if (pit != _playing_peer_list.end()) {
+                    static std::mt19937_64 rng { std::random_device {}() };  // Guarded by _peer_list_mutex
+                    do {
+                        session_token = rng();
+                    } while (session_token == 0);
+                    pit->second->session_token = session_token;
+                }
+            }
+            // Echo back only the flags the server honors; a cleared flag
+            // tells the client to fall back
+            uint32_t reply_cmd = (uint32_t)cmd
+                | (use_multicast ? CMD_FLAG_MULTICAST : 0)
+                | (use_frame_v2 ? CMD_FLAG_FRAME_V2 : 0)
+                | (fec_k ? CMD_FLAG_FEC : 0)
+                | (use_shm ? CMD_FLAG_SHM : 0)
+                | (session_token ? CMD_FLAG_RESUME : 0);
+            if (use_shm) {
+                // Append the region name so the client can map the ring
+                const std::string& shm_name = _shm->name();
+                uint32_t name_len = (uint32_t)shm_name.size();
+                std::array<asio::const_buffer, 4> buffers = {
+                    asio::buffer(&reply_cmd, sizeof(reply_cmd)),
+                    asio::buffer(&id, sizeof(id)),
+                    asio::buffer(&name_len, sizeof(name_len)),
+                    asio::buffer(shm_name),
+                };
+                auto [ec, _] = co_await asio::async_write(*peer, buffers);
+                if (ec) {
+                    spdlog::trace("{} {}", __func__, ec);
+                    close_session(peer);
+                    break;
+                }
+            } else if (use_multicast) {
+                // Append the group so the client knows where to join
+                uint32_t group = _multicast_group.to_uint();
+                uint16_t group_port = _multicast_port;
+                std::array<asio::const_buffer, 4> buffers = {
+                    asio::buffer(&reply_cmd, sizeof(reply_cmd)),
+                    asio::buffer(&id, sizeof(id)),
+                    asio::buffer(&group, sizeof(group)),
+                    asio::buffer(&group_port, sizeof(group_port)),
+                };
+                auto [ec, _] = co_await asio::async_write(*peer, buffers);
+                if (ec) {
+                    spdlog::trace("{} {}", __func__, ec);
+                    close_session(peer);
+                    break;
+                }
+            } else {
+                std::array<asio::const_buffer, 2> buffers = {
+                    asio::buffer(&reply_cmd, sizeof(reply_cmd)),
+                    asio::buffer(&id, sizeof(id)),
+                };
+                auto [ec, _] = co_await asio::async_write(*peer, buffers);
+                if (ec) {
+                    spdlog::trace("{} {}", __func__, ec);
+                    close_session(peer);
+                    break;
+                }
+                // Sites that firewall inbound-unrelated UDP never get the
+                // registration datagram through; watch for it and fall back
+                // to streaming over this socket
+                asio::co_spawn(co_await asio::this_coro::executor, udp_fallback_watch(peer), asio::detached);
+            }
+            if (session_token != 0) {
+                // The token rides after the normal reply, so clients that
+                // never asked for it parse the reply unchanged
+                auto [tk_ec, tk_n] = co_await asio::async_write(*peer, asio::buffer(&session_token, sizeof(session_token)));
+                if (tk_ec) {
+                    spdlog::trace("{} {}", __func__, tk_ec);
+                    close_session(peer);
+                    break;
+                }
+            }
+        } else if (cmd == cmd_t::cmd_resume_play) {
+            uint64_t token = 0;
+            auto [t_ec, t_n] = co_await asio::async_read(*peer, asio::buffer(&token, sizeof(token)));
+            if (t_ec) {
+                close_session(peer);
+                spdlog::trace("{} {}", __func__, t_ec);
+                break;
+            }
+            auto info = resume_playing_peer(peer, token, co_await asio::this_coro::executor);
+            // id 0 tells the client its token expired; it falls back to the
+            // full cmd_start_play handshake
+            int id = info ? info->id : 0;
+            std::array<asio::const_buffer, 2> buffers = {
+                asio::buffer(&cmd, sizeof(cmd)),
+                asio::buffer(&id, sizeof(id)),
+            };
+            auto [r_ec, r_n] = co_await asio::async_write(*peer, buffers);
+            if (r_ec) {
+                spdlog::trace("{} {}", __func__, r_ec);
+                close_session(peer);
+                break;
+            }
+            if (info && !info->multicast && !info->shm && info->udp_peer.port() == 0) {
+                // A resumed TCP-fallback peer re-earns its datagram path the
+                // same way a fresh one does
+                asio::co_spawn(co_await asio::this_coro::executor, udp_fallback_watch(peer), asio::detached);
+            }
+        } else if (cmd == cmd_t::cmd_heartbeat) {
+            std::lock_guard<std::mutex> lock(_peer_list_mutex);
+            auto it = _playing_peer_list.find(peer);
+            if (it != _playing_peer_list.end()) {
+                it->second->last_tick.store(std::chrono::steady_clock::now());
+            }
+        } else if (cmd == cmd_t::cmd_heartbeat_stats) {
+            // [high_seq:u32][lost:u32], both cumulative on the client side
+            uint32_t stats[2] = {};
+            auto [stats_ec, stats_n] = co_await asio::async_read(*peer, asio::buffer(stats));
+            if (stats_ec) {
+                close_session(peer);
+                spdlog::trace("{} {}", __func__, stats_ec);
+                break;
+            }
+            std::lock_guard<std::mutex> lock(_peer_list_mutex);
+            auto it = _playing_peer_list.find(peer);
+            if (it != _playing_peer_list.end()) {
+                it->second->last_tick.store(std::chrono::steady_clock::now());
+                adapt_peer_quality(it->second, stats[0], stats[1]);
+            }
+        } else if (cmd == cmd_t::cmd_get_stats) {
+            auto stats = audio_share::metrics::instance().to_json();
+            auto size = (uint32_t)stats.size();
+            std::array<asio::const_buffer, 3> buffers = {
+                asio::buffer(&cmd, sizeof(cmd)),
+                asio::buffer(&size, sizeof(size)),
+                asio::buffer(stats),
+            };
+            auto [write_ec, write_n] = co_await asio::async_write(*peer, buffers);
+            if (write_ec) {
+                close_session(peer);
+                spdlog::trace("{} {}", __func__, write_ec);
+                break;
+            }
+        } else if (cmd == cmd_t::cmd_set_codec) {
+            uint32_t codec = 0;
+            auto [codec_ec, codec_n] = co_await asio::async_read(*peer, asio::buffer(&codec, sizeof(codec)));
+            if (codec_ec) {
+                close_session(peer);
+                spdlog::trace("{} {}", __func__, codec_ec);
+                break;
+            }
+            uint32_t accepted = set_peer_codec(peer, (audio_codec_t)codec) ? 1 : 0;
+            std::array<asio::const_buffer, 2> buffers = {
+                asio::buffer(&cmd, sizeof(cmd)),
+                asio::buffer(&accepted, sizeof(accepted)),
+            };
+            auto [write_ec, write_n] = co_await asio::async_write(*peer, buffers);
+            if (write_ec) {
+                spdlog::trace("{} {}", __func__, write_ec);
+                close_session(peer);
+                break;
+            }
+        } else if (cmd == cmd_t::cmd_set_encoding) {
+            uint32_t encoding = 0;
+            auto [enc_ec, enc_n] = co_await asio::async_read(*peer, asio::buffer(&encoding, sizeof(encoding)));
+            if (enc_ec) {
+                close_session(peer);
+                spdlog::trace("{} {}", __func__, enc_ec);
+                break;
+            }
+            uint32_t accepted = set_peer_encoding(peer, (audio_manager::encoding_t)encoding) ? 1 : 0;
+            std::array<asio::const_buffer, 2> buffers = {
+                asio::buffer(&cmd, sizeof(cmd)),
+                asio::buffer(&accepted, sizeof(accepted)),
+            };
+            auto [write_ec, write_n] = co_await asio::async_write(*peer, buffers);
+            if (write_ec) {
+                spdlog::trace("{} {}", __func__, write_ec);
+                close_session(peer);
+                break;
+            }
+        } else if (cmd == cmd_t::cmd_set_sample_rate) {
+            uint32_t sample_rate = 0;
+            auto [rate_ec, rate_n] = co_await asio::async_read(*peer, asio::buffer(&sample_rate, sizeof(sample_rate)));
+            if (rate_ec) {
+                close_session(peer);
+                spdlog::trace("{} {}", __func__, rate_ec);
+                break;
+            }
+            uint32_t accepted = set_peer_sample_rate(peer, (int)sample_rate) ? 1 : 0;
+            std::array<asio::const_buffer, 2> buffers = {
+                asio::buffer(&cmd, sizeof(cmd)),
+                asio::buffer(&accepted, sizeof(accepted)),
+            };
+            auto [write_ec, write_n] = co_await asio::async_write(*peer, buffers);
+            if (write_ec) {
+                spdlog::trace("{} {}", __func__, write_ec);
+                close_session(peer);
+                break;
+            }
+        } else if (cmd == cmd_t::cmd_dump_recorder) {
+            // dump() reads the ring, so it joins the broadcast strand where
+            // the writer lives; the disk write itself runs off-strand
+            std::string path = co_await asio::co_spawn(*_broadcast_strand, [this]() -> asio::awaitable<std::string> {
+                co_return _recorder ? _recorder->dump() : std::string {};
+            }, asio::use_awaitable);
+            auto size = (uint32_t)path.size();
+            std::array<asio::const_buffer, 3> buffers = {
+                asio::buffer(&cmd, sizeof(cmd)),
+                asio::buffer(&size, sizeof(size)),
+                asio::buffer(path),
+            };
+            auto [write_ec, write_n] = co_await asio::async_write(*peer, buffers);
+            if (write_ec) {
+                spdlog::trace("{} {}", __func__, write_ec);
+                close_session(peer);
+                break;
+            }
+        } else {
+            spdlog::error("{} error cmd", __func__);
+            close_session(peer);
+            break;
+        }
+    }
+    spdlog::trace("stop {}", __func__);
+}
+
+asio::awaitable<void> network_manager::heartbeat_sweep_loop()
+{
+    // One pass over the whole peer list per interval: collect expired peers
+    // and heartbeat targets under a single lock acquisition, then act on
+    // them outside the lock. Control-plane cost stays one timer regardless
+    // of client count.
+    std::error_code ec;
+    std::vector<std::pair<std::shared_ptr<tcp_socket>, asio::any_io_executor>> expired;
+    std::vector<std::pair<std::shared_ptr<tcp_socket>, asio::any_io_executor>> alive;
+    std::vector<std::pair<int, asio::ip::udp::endpoint>> probe_list;  // (peer id, endpoint)
+
+    while (true) {
+        _heartbeat_timer->expires_after(HEARTBEAT_INTERVAL);
+        std::tie(ec) = co_await _heartbeat_timer->async_wait();
+        if (ec) {
+            break;
+        }
+
+        expired.clear();
+        alive.clear();
+        probe_list.clear();
+        auto now = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lock(_peer_list_mutex);
+            for (auto& [peer, info] : _playing_peer_list) {
+                if (!peer->is_open()) {
+                    expired.emplace_back(peer, info->executor);
+                    continue;
+                }
+                if (now - info->last_tick.load() > _heartbeat_timeout) {
+                    spdlog::info("{} timeout", peer->remote_endpoint());
+                    expired.emplace_back(peer, info->executor);
+                    continue;
+                }
+                if (info->udp_peer.port() != 0 && !info->multicast) {
+                    // Re-probe the path MTU on the heartbeat cadence; the
+                    // kernel route cache already absorbed any ICMP
+                    // fragmentation-needed feedback since the last probe.
+                    // Collected here, probed below -- a probe is a socket
+                    // create + connect per peer, too slow to run under the
+                    // mutex fill_udp_peer takes on the broadcast strand.
+                    probe_list.emplace_back(info->id, info->udp_peer);
+                }
+                if (info->tcp_stream) {
+                    // The audio frames themselves keep a fallback peer's
+                    // connection warm; a separate heartbeat write could
+                    // interleave with an in-flight frame gather
+                    continue;
+                }
+                alive.emplace_back(peer, info->executor);
+            }
+        }
+
+        if (!probe_list.empty()) {
+            // Probe outside the lock, then re-lock briefly to apply the
+            // results; a peer that left in between just misses this round
+            bool snapshot_dirty = false;
+            for (auto& [id, endpoint] : probe_list) {
+                int payload = probe_udp_payload(endpoint);
+                std::lock_guard<std::mutex> lock(_peer_list_mutex);
+                auto it = _peer_index.find(id);
+                // The endpoint was copied before the probe; skip a peer
+                // that re-registered meanwhile so a stale result never
+                // sticks
+                if (it == _peer_index.end() || it->second.second->udp_peer != endpoint) {
+                    continue;
+                }
+                auto& info = it->second.second;
+                if (payload != info->udp_payload) {
+                    spdlog::info("{} path MTU change for id:{}, payload {} -> {}", __func__, info->id, info->udp_payload, payload);
+                    info->udp_payload = payload;
+                    snapshot_dirty = true;
+                }
+            }
+            if (snapshot_dirty) {
+                std::lock_guard<std::mutex> lock(_peer_list_mutex);
+                publish_peer_snapshot();
+            }
+        }
+
+        for (auto& [peer, executor] : expired) {
+            // Close on the peer's strand: its read_loop has an async_read
+            // pending on the same socket, and asio sockets are not
+            // thread-safe
+            asio::co_spawn(executor, [self = shared_from_this(), peer]() mutable -> asio::awaitable<void> {
+                self->close_session(peer);
+                co_return;
+            }, asio::detached);
+        }
+        for (auto& [peer, executor] : alive) {
+            // The write joins the peer's strand so it serializes with the
+            // read_loop's command replies on the same socket
+            asio::co_spawn(executor, send_heartbeat(peer), asio::detached);
+        }
+    }
+    spdlog::trace("stop {}", __func__);
+}
+
+asio::awaitable<void> network_manager::udp_fallback_watch(std::shared_ptr<tcp_socket> peer)
+{
+    steady_timer timer(co_await asio::this_coro::executor);
+    timer.expires_after(audio_share::constants::TCP_FALLBACK_TIMEOUT);
+    auto [ec] = co_await timer.async_wait();
+    if (ec) {
+        co_return;
+    }
+
+    std::lock_guard<std::mutex> lock(_peer_list_mutex);
+    auto it = _playing_peer_list.find(peer);
+    if (it == _playing_peer_list.end()) {
+        co_return;  // Peer already gone
+    }
+    auto& info = it->second;
+    if (info->udp_peer.port() != 0 || info->multicast || info->shm || info->tcp_stream) {
+        co_return;  // Registration arrived, or the peer never needed UDP
+    }
+    info->tcp_stream = true;
+    info->tcp_outbox = std::make_shared<tcp_outbox_t>();
+    info->tcp_outbox->executor = info->executor;
+    publish_peer_snapshot();
+    spdlog::info("no udp registration from id:{} within {}s, streaming over tcp", info->id,
+        std::chrono::duration_cast<std::chrono::seconds>(audio_share::constants::TCP_FALLBACK_TIMEOUT).count());
+}
+
+#ifdef linux
+asio::awaitable<void> network_manager::dump_signal_loop()
+{
+    // Runs on the broadcast strand, so each dump serializes with record()
+    asio::signal_set signals(co_await asio::this_coro::executor, SIGUSR1);
+    while (true) {
+        auto [ec, signo] = co_await signals.async_wait(asio::as_tuple(asio::use_awaitable));
+        if (ec) {
+            break;
+        }
+        if (_recorder) {
+            auto path = _recorder->dump();
+            spdlog::info("SIGUSR1: flight recorder snapshot -> {}", path);
+        }
+    }
+    spdlog::trace("stop {}", __func__);
+}
+#endif
+
+asio::awaitable<void> network_manager::send_heartbeat(std::shared_ptr<tcp_socket> peer)
+{
+    auto cmd = cmd_t::cmd_heartbeat;
+    auto [ec, _] = co_await asio::async_write(*peer, asio::buffer(&cmd, sizeof(cmd)));
+    if (ec) {
+        spdlog::trace("{} {}", __func__, ec);
+        close_session(peer);
+    }
+}
+
+asio::awaitable<void> network_manager::accept_tcp_loop(tcp_acceptor acceptor)
+{
+    while (true) {
+        auto peer = std::make_shared<tcp_socket>(acceptor.get_executor());
+        auto [ec] = co_await acceptor.async_accept(*peer);
+        if (ec) {
+            spdlog::error("{} {}", __func__, ec);
+            co_return;
+        }
+
+        spdlog::info("accept {}", peer->remote_endpoint());
+
+        // No-Delay
+        peer->set_option(ip::tcp::no_delay(true), ec);
+        if (ec) {
+            spdlog::info("{} {}", __func__, ec);
+        }
+
+        // Mark the control socket like the audio it may end up carrying
+        // (heartbeats now, the whole stream on the TCP fallback)
+        if (_socket_tuner) {
+            auto remote = peer->remote_endpoint(ec);
+            if (!ec) {
+                _socket_tuner->tune_tcp_peer((uintptr_t)peer->native_handle(), remote.data(), remote.size());
+            }
+        }
+
+        // Each peer's coroutines run on their own strand so per-peer control
+        // traffic is serialized while peers scale across the thread pool
+        asio::co_spawn(asio::make_strand(*_ioc), read_loop(peer), asio::detached);
+    }
+}
+
+asio::awaitable<void> network_manager::accept_udp_loop()
+{
+#ifdef linux
+    // Registration datagrams arrive in bursts on reconnect storms. Wait for
+    // readability, then drain the socket with recvmmsg so one syscall covers
+    // the whole burst instead of one wakeup per 4-byte datagram.
+    constexpr int RECV_BATCH = 32;
+    while (true) {
+        auto [ec] = co_await _udp_server->async_wait(asio::socket_base::wait_read);
+        if (ec) {
+            spdlog::info("{} {}", __func__, ec);
+            co_return;
+        }
+
+        int ids[RECV_BATCH] {};
+        sockaddr_storage addrs[RECV_BATCH];
+        iovec iovs[RECV_BATCH];
+        mmsghdr msgs[RECV_BATCH];
+        while (true) {
+            for (int i = 0; i < RECV_BATCH; ++i) {
+                iovs[i] = { &ids[i], sizeof(ids[i]) };
+                msgs[i] = {};
+                msgs[i].msg_hdr.msg_iov = &iovs[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+                msgs[i].msg_hdr.msg_name = &addrs[i];
+                msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+            }
+
+            int received = 0;
+            do {
+                received = ::recvmmsg(_udp_server->native_handle(), msgs, RECV_BATCH, MSG_DONTWAIT, nullptr);
+            } while (received < 0 && errno == EINTR);
+            if (received <= 0) {
+                break;  // drained (EAGAIN) or spurious wakeup, wait again
+            }
+
+            for (int i = 0; i < received; ++i) {
+                if (msgs[i].msg_len != sizeof(int)) {
+                    AUDIO_SHARE_LOG_EVERY_MS(spdlog::level::trace, 1000, "{} ignore {}-byte datagram", __func__, msgs[i].msg_len);
+                    continue;
+                }
+                ip::udp::endpoint udp_peer;
+                std::memcpy(udp_peer.data(), &addrs[i], msgs[i].msg_hdr.msg_namelen);
+                udp_peer.resize(msgs[i].msg_hdr.msg_namelen);
+                fill_udp_peer(ids[i], udp_peer);
+            }
+
+            if (received < RECV_BATCH) {
+                break;  // short batch means the queue is empty
+            }
+        }
+    }
+#else
+    while (true) {
+        int id = 0;
+        ip::udp::endpoint udp_peer;
+        auto [ec, _] = co_await _udp_server->async_receive_from(asio::buffer(&id, sizeof(id)), udp_peer);
+        if (ec) {
+            spdlog::info("{} {}", __func__, ec);
+            co_return;
+        }
+
+        fill_udp_peer(id, udp_peer);
+    }
+#endif
+}
+
+auto network_manager::close_session(std::shared_ptr<tcp_socket>& peer) -> playing_peer_list_t::iterator
+{
+    spdlog::info("close {}", peer->remote_endpoint());
+    auto it = remove_playing_peer(peer);
+    peer->shutdown(ip::tcp::socket::shutdown_both);
+    peer->close();
+    return it;
+}
+
+int network_manager::add_playing_peer(std::shared_ptr<tcp_socket>& peer, bool multicast, bool frame_v2, uint16_t fec_k, bool shm, asio::any_io_executor executor)
+{
+    std::lock_guard<std::mutex> lock(_peer_list_mutex);
+    if (_playing_peer_list.contains(peer)) {
+        spdlog::error("{} repeat add tcp://{}", __func__, peer->remote_endpoint());
+        return 0;
+    }
+
+    auto info = _playing_peer_list[peer] = std::make_shared<peer_info_t>();
+    static int g_id = 0;
+    info->id = ++g_id;
+    info->multicast = multicast;
+    info->frame_v2 = frame_v2;
+    info->fec_k = fec_k;
+    info->fec_k_base = fec_k;
+    info->shm = shm;
+    info->executor = std::move(executor);
+    info->last_tick.store(std::chrono::steady_clock::now());
+    _peer_index.emplace(info->id, std::make_pair(peer, info));
+
+    if (multicast || shm) {
+        // Multicast and shm peers never register a unicast UDP endpoint, so
+        // the snapshot has to be refreshed here instead of in fill_udp_peer
+        publish_peer_snapshot();
+    }
+
+    spdlog::trace("{} add id:{}{} tcp://{}", __func__, info->id, multicast ? " (multicast)" : (shm ? " (shm)" : ""), peer->remote_endpoint());
+    return info->id;
+}
+
+std::shared_ptr<network_manager::peer_info_t> network_manager::resume_playing_peer(std::shared_ptr<tcp_socket>& peer, uint64_t token, asio::any_io_executor executor)
+{
+    std::lock_guard<std::mutex> lock(_peer_list_mutex);
+    if (token == 0 || _playing_peer_list.contains(peer)) {
+        return nullptr;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    std::erase_if(_resume_cache, [&](const auto& entry) { return entry.second.expires <= now; });
+    auto it = _resume_cache.find(token);
+    if (it == _resume_cache.end()) {
+        return nullptr;
+    }
+    auto info = it->second.info;
+    _resume_cache.erase(it);
+
+    // Fresh connection, same negotiated stream: encoding, rate, framing and
+    // FEC survive; everything tied to the old socket starts over. The stale
+    // UDP endpoint is kept so audio resumes instantly when the client's
+    // address survived the roam, and the re-registration datagram replaces
+    // it otherwise.
+    info->executor = std::move(executor);
+    info->tcp_stream = false;
+    info->tcp_outbox = nullptr;
+    info->qos_flow_id = 0;
+    info->hb_seen = false;
+    info->hb_clean_intervals = 0;
+    info->last_tick.store(std::chrono::steady_clock::now());
+    _playing_peer_list[peer] = info;
+    _peer_index.emplace(info->id, std::make_pair(peer, info));
+    publish_peer_snapshot();
+    spdlog::info("{} resume id:{} tcp://{}", __func__, info->id, peer->remote_endpoint());
+    return info;
+}
+
+auto network_manager::remove_playing_peer(std::shared_ptr<tcp_socket>& peer) -> playing_peer_list_t::iterator
+{
+    std::lock_guard<std::mutex> lock(_peer_list_mutex);
+    auto it = _playing_peer_list.find(peer);
+    if (it == _playing_peer_list.end()) {
+        spdlog::error("{} repeat remove tcp://{}", __func__, peer->remote_endpoint());
+        return it;
+    }
+
+    if (it->second->session_token != 0) {
+        // Park the negotiated state so a roaming client can resume with its
+        // token instead of renegotiating; pruning on insert and lookup keeps
+        // the cache bounded without a timer
+        const auto now = std::chrono::steady_clock::now();
+        std::erase_if(_resume_cache, [&](const auto& entry) { return entry.second.expires <= now; });
+        if ((int)_resume_cache.size() < MAX_CLIENTS) {
+            _resume_cache[it->second->session_token] = { it->second, now + RESUME_CACHE_TTL };
+        }
+    }
+
+#ifdef _WINDOWS
+    if (_socket_tuner && it->second->qos_flow_id != 0 && _udp_server) {
+        _socket_tuner->remove_udp_flow((uintptr_t)_udp_server->native_handle(), it->second->qos_flow_id);
+    }
+#endif
+    _peer_index.erase(it->second->id);
+    it = _playing_peer_list.erase(it);
+    publish_peer_snapshot();
+    spdlog::trace("{} remove tcp://{}", __func__, peer->remote_endpoint());
+    return it;
+}
+
+int network_manager::probe_udp_payload(const asio::ip::udp::endpoint& orig_peer)
+{
+#ifdef linux
+    // Registration normalizes v4 peers to v4-mapped form; probe the real v4
+    // path so the budget reflects the 20-byte v4 header, not v6's 40
+    auto peer = orig_peer;
+    if (peer.address().is_v6() && peer.address().to_v6().is_v4_mapped()) {
+        peer = asio::ip::udp::endpoint(asio::ip::make_address_v4(asio::ip::v4_mapped, peer.address().to_v6()), peer.port());
+    }
+    // A connected throwaway socket with strict PMTU discovery reads the
+    // kernel's cached path MTU for this destination. The cache is fed by
+    // ICMP fragmentation-needed messages, so re-running the probe after an
+    // MTU drop on the path picks the new value up without any custom ICMP
+    // handling.
+    int fd = ::socket(peer.address().is_v4() ? AF_INET : AF_INET6, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        return MAX_UDP_PAYLOAD_SIZE;
+    }
+
+    int payload = MAX_UDP_PAYLOAD_SIZE;
+    do {
+        if (::connect(fd, (const sockaddr*)peer.data(), (socklen_t)peer.size()) != 0) {
+            break;
+        }
+
+        int mtu = 0;
+        socklen_t len = sizeof(mtu);
+        if (peer.address().is_v4()) {
+            int discover = IP_PMTUDISC_DO;
+            ::setsockopt(fd, IPPROTO_IP, IP_MTU_DISCOVER, &discover, sizeof(discover));
+            if (::getsockopt(fd, IPPROTO_IP, IP_MTU, &mtu, &len) != 0) {
+                break;
+            }
+            payload = mtu - IPV4_HEADER_SIZE - UDP_HEADER_SIZE;
+        } else {
+            int discover = IPV6_PMTUDISC_DO;
+            ::setsockopt(fd, IPPROTO_IPV6, IPV6_MTU_DISCOVER, &discover, sizeof(discover));
+            if (::getsockopt(fd, IPPROTO_IPV6, IPV6_MTU, &mtu, &len) != 0) {
+                break;
+            }
+            payload = mtu - IPV6_HEADER_SIZE - UDP_HEADER_SIZE;
+        }
+    } while (false);
+    ::close(fd);
+
+    // Clamp to the IPv4 minimum-reassembly payload on the low end so a bogus
+    // route can't shatter the stream, and a single datagram on the high end
+    return std::clamp(payload, 548, 65507);
+#else
+    (void)orig_peer;
+    return MAX_UDP_PAYLOAD_SIZE;
+#endif
+}
+
+void network_manager::fill_udp_peer(int id, asio::ip::udp::endpoint udp_peer)
+{
+    {
+        // O(1) id lookup; a registration storm of bogus ids costs one hash
+        // probe each instead of a scan of the whole peer map -- or an MTU
+        // probe, which is why existence is checked before probing below
+        std::lock_guard<std::mutex> lock(_peer_list_mutex);
+        if (_peer_index.find(id) == _peer_index.end()) {
+            spdlog::error("{} no tcp peer id:{} udp://{}", __func__, id, udp_peer);
+            return;
+        }
+    }
+
+    // Normalize to the dual-stack socket's family once here: a bare v4 reply
+    // address becomes its v4-mapped v6 form, so every later send matches the
+    // socket family with no per-quantum check. The kernel already reports v4
+    // senders as v4-mapped on a dual-stack socket, this covers the rest.
+    auto address = udp_peer.address();
+    if (address.is_v4()) {
+        udp_peer = ip::udp::endpoint(ip::make_address_v6(ip::v4_mapped, address.to_v4()), udp_peer.port());
+        spdlog::debug("{} normalized v4 endpoint to v4-mapped: {}", __func__, udp_peer);
+    }
+
+    // Probe outside the lock like the heartbeat sweep: a probe is a socket
+    // create + connect, too slow to hold a mutex the command handlers on
+    // the peer strands also take
+    int udp_payload = probe_udp_payload(udp_peer);
+
+    std::lock_guard<std::mutex> lock(_peer_list_mutex);
+    auto it = _peer_index.find(id);
+    if (it == _peer_index.end()) {
+        // Left while the probe ran
+        spdlog::error("{} no tcp peer id:{} udp://{}", __func__, id, udp_peer);
+        return;
+    }
+    auto& [peer, info] = it->second;
+    if (info->tcp_stream) {
+        // A late registration means UDP does get through after all;
+        // drop back to the normal datagram path
+        info->tcp_stream = false;
+        info->tcp_outbox = nullptr;
+        spdlog::info("{} late udp registration from id:{}, leaving tcp streaming", __func__, id);
+    }
+    info->udp_peer = udp_peer;
+    info->udp_payload = udp_payload;
+#ifdef _WINDOWS
+    // Windows DSCP marking is per-destination: attach a qwave flow for this
+    // endpoint, detached again when the peer leaves
+    if (_socket_tuner && info->qos_flow_id == 0) {
+        info->qos_flow_id = _socket_tuner->add_udp_flow((uintptr_t)_udp_server->native_handle(), udp_peer.data(), udp_peer.size());
+    }
+#endif
+    publish_peer_snapshot();
+    spdlog::info("{} fill udp peer id:{} tcp://{} udp://{} payload:{}", __func__, id, peer->remote_endpoint(), udp_peer, info->udp_payload);
+}
+
+bool network_manager::set_peer_codec(const std::shared_ptr<tcp_socket>& peer, audio_codec_t codec)
+{
+    if (codec != audio_codec_t::codec_raw && codec != audio_codec_t::codec_opus) {
+        spdlog::error("{} unknown codec {}", __func__, (uint32_t)codec);
+        return false;
+    }
+
+#ifndef AUDIO_SHARE_HAS_OPUS
+    if (codec == audio_codec_t::codec_opus) {
+        spdlog::warn("{} peer requested opus but the server was built without opus support", __func__);
+        return false;
+    }
+#endif
+
+    std::lock_guard<std::mutex> lock(_peer_list_mutex);
+
+#ifdef AUDIO_SHARE_HAS_OPUS
+    if (codec == audio_codec_t::codec_opus && !_opus_encoder) {
+        // Lazily create the shared encoder from the capture format, under
+        // the mutex so two peers negotiating opus at once cannot both
+        // construct one. Opus only takes f32/s16 input, other capture
+        // encodings keep the peer on raw.
+        auto format = _audio_manager->get_format();
+        audio_share::opus_stream_encoder::input_format input;
+        if (format->encoding() == audio_manager::AudioFormat::ENCODING_PCM_FLOAT) {
+            input = audio_share::opus_stream_encoder::input_format::f32;
+        } else if (format->encoding() == audio_manager::AudioFormat::ENCODING_PCM_16BIT) {
+            input = audio_share::opus_stream_encoder::input_format::s16;
+        } else {
+            spdlog::warn("{} capture encoding {} cannot feed opus", __func__, (int)format->encoding());
+            return false;
+        }
+
+        auto encoder = std::make_shared<audio_share::opus_stream_encoder>(format->sample_rate(), format->channels(), input);
+        if (!encoder->valid()) {
+            return false;
+        }
+        _opus_encoder = std::move(encoder);
+    }
+#endif
+
+    auto it = _playing_peer_list.find(peer);
+    if (it == _playing_peer_list.end()) {
+        spdlog::error("{} peer is not playing", __func__);
+        return false;
+    }
+    it->second->codec = codec;
+    publish_peer_snapshot();
+    spdlog::info("{} id:{} codec:{}", __func__, it->second->id, codec == audio_codec_t::codec_opus ? "opus" : "raw");
+    return true;
+}
+
+bool network_manager::set_peer_encoding(const std::shared_ptr<tcp_socket>& peer, audio_manager::encoding_t encoding)
+{
+    switch (encoding) {
+    case audio_manager::encoding_t::encoding_default:
+    case audio_manager::encoding_t::encoding_f32:
+    case audio_manager::encoding_t::encoding_s8:
+    case audio_manager::encoding_t::encoding_s16:
+    case audio_manager::encoding_t::encoding_s24:
+    case audio_manager::encoding_t::encoding_s32:
+        break;
+    default:
+        spdlog::error("{} invalid encoding {}", __func__, (uint32_t)encoding);
+        return false;
+    }
+
+    auto format = _audio_manager->get_format();
+    const bool capture_is_f32 = format->encoding() == audio_manager::AudioFormat::ENCODING_PCM_FLOAT;
+
+    // f32 on an f32 capture is a passthrough, store it as default
+    if (encoding == audio_manager::encoding_t::encoding_f32 && capture_is_f32) {
+        encoding = audio_manager::encoding_t::encoding_default;
+    }
+
+    // The conversion engine only reads f32 input; with any other capture
+    // encoding a peer can only take the stream as-is
+    if (encoding != audio_manager::encoding_t::encoding_default && !capture_is_f32) {
+        spdlog::warn("{} capture encoding {} cannot be converted, peer keeps capture format", __func__, (int)format->encoding());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(_peer_list_mutex);
+    auto it = _playing_peer_list.find(peer);
+    if (it == _playing_peer_list.end()) {
+        spdlog::error("{} peer is not playing", __func__);
+        return false;
+    }
+    it->second->encoding = encoding;
+    publish_peer_snapshot();
+    spdlog::info("{} id:{} encoding:{} ({})", __func__, it->second->id, (uint32_t)encoding, audio_share::sample_converter::dispatch_name());
+    return true;
+}
+
+bool network_manager::set_peer_sample_rate(const std::shared_ptr<tcp_socket>& peer, int sample_rate)
+{
+    if (sample_rate != 0 && (sample_rate < 8000 || sample_rate > 192000)) {
+        spdlog::error("{} invalid sample rate {}", __func__, sample_rate);
+        return false;
+    }
+
+    auto format = _audio_manager->get_format();
+
+    // The resampler only reads f32 input; with any other capture encoding a
+    // peer can only take the stream at the capture rate
+    if (sample_rate != 0 && format->encoding() != audio_manager::AudioFormat::ENCODING_PCM_FLOAT) {
+        spdlog::warn("{} capture encoding {} cannot be resampled, peer keeps capture rate", __func__, (int)format->encoding());
+        return false;
+    }
+
+    // The capture rate itself is a passthrough, store it as default
+    if (sample_rate == format->sample_rate()) {
+        sample_rate = 0;
+    }
+
+    std::lock_guard<std::mutex> lock(_peer_list_mutex);
+    auto it = _playing_peer_list.find(peer);
+    if (it == _playing_peer_list.end()) {
+        spdlog::error("{} peer is not playing", __func__);
+        return false;
+    }
+    it->second->sample_rate = sample_rate;
+    publish_peer_snapshot();
+    spdlog::info("{} id:{} sample_rate:{}", __func__, it->second->id, sample_rate ? sample_rate : format->sample_rate());
+    return true;
+}
+
+void network_manager::adapt_peer_quality(const std::shared_ptr<peer_info_t>& info, uint32_t high_seq, uint32_t lost)
+{
+    if (!info->hb_seen) {
+        info->hb_seen = true;
+        info->hb_high_seq = high_seq;
+        info->hb_lost = lost;
+        return;
+    }
+
+    // Cumulative counters, so a dropped report merges into the next window
+    const uint32_t delta_recv = high_seq - info->hb_high_seq;
+    const uint32_t delta_lost = lost - info->hb_lost;
+    info->hb_high_seq = high_seq;
+    info->hb_lost = lost;
+    if (delta_lost > 0) {
+        audio_share::metrics::instance().on_peer_reported_loss(delta_lost);
+    }
+
+    const uint64_t window = (uint64_t)delta_recv + delta_lost;
+    if (window == 0) {
+        return;
+    }
+
+    const int loss_permille = (int)((uint64_t)delta_lost * 1000 / window);
+    if (loss_permille >= QUALITY_LOSS_DEGRADE_PERMILLE) {
+        info->hb_clean_intervals = 0;
+        if (info->frame_v2) {
+            // Denser parity: a smaller group survives more loss per group.
+            // v2 clients read the group size from every frame header, so the
+            // step needs no negotiation round trip - and it moves only this
+            // peer into a different fan-out group.
+            uint16_t fec_k = info->fec_k == 0
+                ? (uint16_t)FEC_MAX_K
+                : (uint16_t)std::max(FEC_MIN_K, info->fec_k / 2u);
+            if (fec_k != info->fec_k) {
+                spdlog::info("{} id:{} lost {}/{} this window, fec_k {} -> {}", __func__, info->id, delta_lost, window, info->fec_k, fec_k);
+                info->fec_k = fec_k;
+                // The peer now hears a differently keyed v2 stream whose
+                // seq counter is unrelated to the old one, so re-baseline
+                // on the next report instead of reading the jump as loss
+                info->hb_seen = false;
+                publish_peer_snapshot();
+            }
+        } else {
+            // v1 peers offer no per-peer knob the client would understand
+            // without renegotiating; just surface the signal
+            AUDIO_SHARE_LOG_EVERY_MS(spdlog::level::info, 10000, "peer id:{} reports {}/{} lost but negotiated no v2 frames to adapt", info->id, delta_lost, window);
+        }
+    } else if (delta_lost == 0 && info->fec_k != info->fec_k_base) {
+        if (++info->hb_clean_intervals >= QUALITY_CLEAN_INTERVALS) {
+            info->hb_clean_intervals = 0;
+            // Recover one step toward what the client asked for: sparser
+            // parity, or none at all if it never wanted FEC
+            uint16_t fec_k = (uint16_t)(info->fec_k * 2u);
+            if (info->fec_k_base == 0) {
+                if (fec_k > FEC_MAX_K) {
+                    fec_k = 0;
+                }
+            } else if (fec_k > info->fec_k_base) {
+                fec_k = info->fec_k_base;
+            }
+            spdlog::info("{} id:{} clean for {} reports, fec_k {} -> {}", __func__, info->id, QUALITY_CLEAN_INTERVALS, info->fec_k, fec_k);
+            info->fec_k = fec_k;
+            // Same re-baseline as the degrade step: the new stream key
+            // means a new seq counter
+            info->hb_seen = false;
+            publish_peer_snapshot();
+        }
+    } else if (delta_lost != 0) {
+        info->hb_clean_intervals = 0;
+    }
+}
+
+void network_manager::publish_peer_snapshot()
+{
+    // Build a fresh immutable snapshot from the peer list and publish it for
+    // the lock-free broadcast side. Endpoints were normalized to the
+    // dual-stack socket's family at registration, so no family filtering is
+    // needed here or per quantum.
+    auto snapshot = std::make_shared<peer_snapshot_t>();
+
+    for (const auto& [peer, info] : _playing_peer_list) {
+        if (info->shm) {
+            // shm peers read the same-host ring; no UDP target at all
+            ++snapshot->shm_consumers;
+            continue;
+        }
+        if (info->multicast) {
+            // All group listeners share one send to the group endpoint,
+            // normalized to its v4-mapped form like every unicast peer so
+            // the destination family always matches the dual-stack socket
+            if (snapshot->multicast_targets.empty() && !_multicast_group.is_unspecified()) {
+                snapshot->multicast_targets.push_back({ 0, ip::udp::endpoint(ip::make_address_v6(ip::v4_mapped, _multicast_group), _multicast_port) });
+            }
+            continue;
+        }
+        if (info->tcp_stream) {
+            snapshot->tcp_targets.push_back({ info->id, peer, info->encoding, info->tcp_outbox });
+            continue;
+        }
+        const auto& udp_ep = info->udp_peer;
+        if (udp_ep.port() == 0) {
+            // UDP endpoint not registered yet
+            continue;
+        }
+        if (info->codec == audio_codec_t::codec_opus) {
+            snapshot->opus_targets.push_back({ info->id, udp_ep });
+        } else {
+            auto group = std::find_if(snapshot->pcm_groups.begin(), snapshot->pcm_groups.end(), [&](const target_group_t& g) {
+                return g.encoding == info->encoding && g.sample_rate == info->sample_rate && g.frame_v2 == info->frame_v2 && g.fec_k == info->fec_k && g.max_payload == info->udp_payload;
+            });
+            if (group == snapshot->pcm_groups.end()) {
+                snapshot->pcm_groups.push_back({ info->encoding, info->sample_rate, info->frame_v2, info->fec_k, info->udp_payload, {} });
+                group = std::prev(snapshot->pcm_groups.end());
+            }
+            group->targets.push_back({ info->id, udp_ep });
+        }
+    }
+
+#ifdef AUDIO_SHARE_HAS_OPUS
+    snapshot->opus_encoder = _opus_encoder;
+#endif
+
+    _peer_snapshot.store(std::move(snapshot), std::memory_order_release);
+}
+
+/**
+ * @brief XOR @p n bytes of @p src into @p dst, word-wide.
+ *
+ * Same shape as is_silence: 8-byte lanes with a bytewise tail, which the
+ * compiler widens to 16/32-byte vector XORs. The parity fold runs over
+ * every v2 payload byte each quantum, so the generic byte loop was the
+ * last per-byte work left in the broadcast path.
+ */
+static void xor_fold(uint8_t* dst, const uint8_t* src, size_t n)
+{
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)) {
+        uint64_t a, b;
+        std::memcpy(&a, dst + i, sizeof(a));
+        std::memcpy(&b, src + i, sizeof(b));
+        a ^= b;
+        std::memcpy(dst + i, &a, sizeof(a));
+    }
+    for (; i < n; ++i) {
+        dst[i] ^= src[i];
+    }
+}
+
+/**
+ * @brief Whether a quantum is digital silence (every byte zero).
+ *
+ * OR-reduction over 8-byte lanes with a bytewise tail; compilers vectorize
+ * the lane loop to 16/32-byte compares, so a 10 ms quantum costs well under
+ * a microsecond.
+ */
+static bool is_silence(const char* data, size_t count)
+{
+    uint64_t acc = 0;
+    const size_t lanes = count / sizeof(uint64_t);
+    for (size_t i = 0; i < lanes; ++i) {
+        uint64_t lane;
+        std::memcpy(&lane, data + i * sizeof(uint64_t), sizeof(lane));
+        acc |= lane;
+    }
+    for (size_t i = lanes * sizeof(uint64_t); i < count; ++i) {
+        acc |= (unsigned char)data[i];
+    }
+    return acc == 0;
+}
+
+void network_manager::broadcast_audio_data(const char* data, size_t count, int block_align)
+{
+    if (count <= 0 || !_ioc) {
+        return;
+    }
+
+    // Silence gate: idle machines stream digital silence for hours, so
+    // all-zero quanta older than the hangover are shrunk to a one-frame
+    // keepalive at SILENCE_KEEPALIVE_INTERVAL cadence - clients keep their
+    // jitter buffers primed while the copy/segment/send pipeline goes idle.
+    // The first non-zero sample resumes full broadcast immediately.
+    if (_silence_hangover_ms > 0 && is_silence(data, count)) {
+        auto now = std::chrono::steady_clock::now();
+        if (!_silence_suppressing) {
+            if (_silence_since == std::chrono::steady_clock::time_point {}) {
+                _silence_since = now;
+            }
+            if (now - _silence_since >= std::chrono::milliseconds(_silence_hangover_ms)) {
+                _silence_suppressing = true;
+                _silence_last_keepalive = now;
+                spdlog::debug("silence gate engaged, suppressing broadcast");
+            }
+        }
+        if (_silence_suppressing) {
+            if (now - _silence_last_keepalive < audio_share::constants::SILENCE_KEEPALIVE_INTERVAL) {
+                audio_share::metrics::instance().on_quantum_suppressed();
+                return;
+            }
+            _silence_last_keepalive = now;
+            if (block_align > 0 && (size_t)block_align < count) {
+                count = (size_t)block_align;  // one silent frame as the keepalive marker
+            }
+        }
+    } else {
+        if (_silence_suppressing) {
+            spdlog::debug("silence gate released, resuming broadcast");
+        }
+        _silence_suppressing = false;
+        _silence_since = {};
+    }
+
+    // Producer side of the capture ring. This runs on the realtime capture
+    // thread, so it must never take a mutex or hit the allocator: the quantum
+    // is copied into the preallocated ring and the consumer is scheduled at
+    // most once per quantum. The recycling allocator makes the post itself
+    // allocation-free in steady state.
+    audio_share::metrics::instance().on_quantum_captured();
+    if (!_capture_ring.push(data, (uint32_t)count, block_align)) {
+        audio_share::metrics::instance().on_queue_drop();
+    }
+
+    if (!_drain_scheduled.exchange(true, std::memory_order_acq_rel)) {
+        // Drains are posted to the broadcast strand, which keeps the ring
+        // consumer single even when the io_context runs on a thread pool
+        asio::post(*_broadcast_strand, asio::bind_allocator(asio::recycling_allocator<void>(), [self = shared_from_this()] {
+            self->drain_capture_ring();
+        }));
+    }
+}
+
+void network_manager::drain_capture_ring()
+{
+    // Clear the flag before draining so a producer push that races with the
+    // final empty check schedules a fresh drain instead of being lost.
+    _drain_scheduled.store(false, std::memory_order_release);
+
+    int32_t block_align = 0;
+    uint64_t capture_us = 0;
+    while (true) {
+        // Pop straight into a pooled slab so the quantum is copied exactly
+        // once; every segment below is just a view into this slab.
+        auto slab = _slab_pool->acquire();
+        uint32_t count = _capture_ring.pop(*slab, block_align, capture_us);
+        if (count == 0) {
+            break;
+        }
+        broadcast_quantum(slab, count, block_align, capture_us);
+
+        // sendmmsg is synchronous, so by here the quantum has normally hit
+        // the socket; the async fallback slightly undershoots, acceptable
+        // for a dashboard histogram
+        const uint64_t now_us = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        audio_share::metrics::instance().on_capture_to_send(now_us - capture_us);
+    }
+}
+
+// Maps a negotiated wire encoding onto the conversion engine's enum;
+// returns false for the passthrough/default case
+static bool pcm_target_encoding(audio_manager::encoding_t encoding, audio_share::sample_converter::pcm_encoding& out)
+{
+    switch (encoding) {
+    case audio_manager::encoding_t::encoding_s8:
+        out = audio_share::sample_converter::pcm_encoding::s8;
+        return true;
+    case audio_manager::encoding_t::encoding_s16:
+        out = audio_share::sample_converter::pcm_encoding::s16;
+        return true;
+    case audio_manager::encoding_t::encoding_s24:
+        out = audio_share::sample_converter::pcm_encoding::s24;
+        return true;
+    case audio_manager::encoding_t::encoding_s32:
+        out = audio_share::sample_converter::pcm_encoding::s32;
+        return true;
+    default:
+        return false;
+    }
+}
+
+void network_manager::broadcast_quantum(const audio_share::buffer_pool::buffer_ptr& slab, size_t count, int block_align, uint64_t capture_us)
+{
+    // spdlog::trace("broadcast_quantum count: {}", count);
+
+    // Forward to additional broadcasters (e.g., WebSocket)
+    {
+        std::lock_guard<std::mutex> lock(_broadcasters_mutex);
+        for (const auto& broadcaster : _additional_broadcasters) {
+            if (broadcaster) {
+                broadcaster->broadcast_audio_data((const char*)slab->data(), count, block_align);
+            }
+        }
+    }
+
+    // Flight recorder sees every quantum whether or not anyone is playing:
+    // plain stores into the mapping, no syscalls
+    if (_recorder) {
+        _recorder->record((const char*)slab->data(), (uint32_t)count, block_align, capture_us);
+    }
+
+    // Quantum duration drives the pacer's train spacing; resampled and
+    // converted group payloads differ in size but cover the same span
+    if (_pace_trains > 1 && block_align > 0) {
+        const auto& format = _audio_manager->get_format();
+        if (format && format->sample_rate() > 0) {
+            _pace_quantum_us = (uint64_t)(count / (size_t)block_align) * 1000000 / (uint64_t)format->sample_rate();
+        }
+    }
+
+    // Load the published peer snapshot lock-free; family filtering and
+    // endpoint validation already happened when the snapshot was built.
+    auto snapshot = _peer_snapshot.load(std::memory_order_acquire);
+    if (!snapshot) {
+        return;
+    }
+
+    // Same-host consumers get the raw capture quantum through the shared
+    // ring: one copy, no syscalls beyond the wake. The snapshot's acquire
+    // load also orders the ring construction on the control path.
+    if (snapshot->shm_consumers > 0 && _shm) {
+        _shm->write_quantum((const char*)slab->data(), (uint32_t)count, block_align, capture_us);
+    }
+
+    // One send per segment covers every group listener, regardless of count
+    if (!snapshot->multicast_targets.empty()) {
+        // The group path is shared by all listeners, keep the conservative
+        // worst-case payload
+        segment_and_flush(slab, count, block_align, snapshot->multicast_targets, MAX_UDP_PAYLOAD_SIZE);
+    }
+
+    // Per-rate resampler output for this quantum; groups sharing a granted
+    // rate reuse it, and a converter is fed the quantum exactly once so its
+    // streaming history stays coherent
+    std::map<int, std::pair<audio_share::buffer_pool::buffer_ptr, size_t>> resampled_by_rate;
+
+    for (const auto& group : snapshot->pcm_groups) {
+        auto group_slab = slab;
+        size_t group_count = count;
+        if (group.sample_rate > 0 && block_align > 0) {
+            auto cached = resampled_by_rate.find(group.sample_rate);
+            if (cached == resampled_by_rate.end()) {
+                auto& resampler = _resamplers[group.sample_rate];
+                if (!resampler) {
+                    const auto& format = _audio_manager->get_format();
+                    resampler = std::make_unique<audio_share::sample_rate_converter>(format->sample_rate(), group.sample_rate, format->channels());
+                }
+                auto resampled_slab = _slab_pool->acquire();
+                size_t resampled_count = resampler->process((const float*)slab->data(), count / (size_t)block_align, *resampled_slab);
+                cached = resampled_by_rate.emplace(group.sample_rate, std::make_pair(std::move(resampled_slab), resampled_count)).first;
+            }
+            group_slab = cached->second.first;
+            group_count = cached->second.second;
+            if (group_count == 0) {
+                // Downsampling can leave a short quantum entirely between
+                // output ticks; nothing to send this round
+                continue;
+            }
+        }
+
+        if (group.encoding == audio_manager::encoding_t::encoding_default) {
+            if (group.frame_v2) {
+                segment_and_flush_v2(group_slab, group_count, block_align, group.targets, capture_us, _v2_streams[{ group.encoding, group.sample_rate, group.fec_k, group.max_payload }], group.fec_k, group.max_payload);
+            } else {
+                segment_and_flush(group_slab, group_count, block_align, group.targets, group.max_payload);
+            }
+            continue;
+        }
+
+        // Convert the f32 quantum once for this whole encoding group
+        audio_share::sample_converter::pcm_encoding target_encoding;
+        if (!pcm_target_encoding(group.encoding, target_encoding)) {
+            continue;
+        }
+
+        const size_t samples = group_count / sizeof(float);
+        const size_t sample_bytes = audio_share::sample_converter::bytes_per_sample(target_encoding);
+        const size_t converted_count = samples * sample_bytes;
+
+        auto converted_slab = _slab_pool->acquire();
+        converted_slab->resize(converted_count);
+        audio_share::sample_converter::convert_f32((const float*)group_slab->data(), samples, target_encoding, converted_slab->data());
+
+        const int converted_block_align = block_align / (int)sizeof(float) * (int)sample_bytes;
+        if (group.frame_v2) {
+            segment_and_flush_v2(converted_slab, converted_count, converted_block_align, group.targets, capture_us, _v2_streams[{ group.encoding, group.sample_rate, group.fec_k, group.max_payload }], group.fec_k, group.max_payload);
+        } else {
+            segment_and_flush(converted_slab, converted_count, converted_block_align, group.targets, group.max_payload);
+        }
+    }
+
+    // Peers behind UDP-hostile firewalls stream over their control socket:
+    // one length-prefixed frame per quantum, coalesced per peer into gather
+    // writes. Like the UDP groups, conversion runs once per distinct
+    // encoding, not once per peer.
+    if (!snapshot->tcp_targets.empty()) {
+        std::map<audio_manager::encoding_t, std::pair<audio_share::buffer_pool::buffer_ptr, size_t>> converted_by_encoding;
+        for (const auto& target : snapshot->tcp_targets) {
+            auto frame_slab = slab;
+            size_t frame_count = count;
+            audio_share::sample_converter::pcm_encoding target_encoding;
+            if (pcm_target_encoding(target.encoding, target_encoding)) {
+                auto cached = converted_by_encoding.find(target.encoding);
+                if (cached == converted_by_encoding.end()) {
+                    const size_t samples = count / sizeof(float);
+                    const size_t sample_bytes = audio_share::sample_converter::bytes_per_sample(target_encoding);
+                    auto converted_slab = _slab_pool->acquire();
+                    converted_slab->resize(samples * sample_bytes);
+                    audio_share::sample_converter::convert_f32((const float*)slab->data(), samples, target_encoding, converted_slab->data());
+                    cached = converted_by_encoding.emplace(target.encoding, std::make_pair(std::move(converted_slab), samples * sample_bytes)).first;
+                }
+                frame_slab = cached->second.first;
+                frame_count = cached->second.second;
+            }
+            enqueue_tcp_frame(target, frame_slab, frame_count);
+        }
+    }
+
+#ifdef AUDIO_SHARE_HAS_OPUS
+    if (snapshot->opus_encoder && !snapshot->opus_targets.empty()) {
+        // Encode the quantum once and fan the same packets out to every
+        // opus-capable peer. Packets land in their own pooled slab so the
+        // async fallback path can keep them alive.
+        auto opus_slab = _slab_pool->acquire();
+        opus_slab->clear();
+        std::vector<audio_share::opus_stream_encoder::packet_t> packets;
+        snapshot->opus_encoder->encode(slab->data(), count, *opus_slab, packets);
+
+        if (!packets.empty()) {
+            std::vector<seg_view> packet_segs;
+            packet_segs.reserve(packets.size());
+            for (const auto& [offset, len] : packets) {
+                packet_segs.push_back({ offset, len });
+            }
+            flush_udp_batch(opus_slab, packet_segs, snapshot->opus_targets);
+        }
+    }
+#endif
+}
+
+void network_manager::enqueue_tcp_frame(const tcp_target_t& target, const audio_share::buffer_pool::buffer_ptr& slab, size_t count)
+{
+    // Hop onto the peer's strand; the outbox is only ever touched there.
+    // While a gather write is in flight, quanta just pile into pending and
+    // the write completion flushes them all in one async_write.
+    asio::dispatch(target.outbox->executor,
+        [self = shared_from_this(), socket = target.socket, outbox = target.outbox, slab, count] {
+            if ((int)outbox->pending.size() >= audio_share::constants::MAX_TCP_OUTBOX_QUANTA) {
+                // A stalled receiver gets the freshest audio, not a backlog
+                outbox->pending.erase(outbox->pending.begin());
+                audio_share::metrics::instance().on_queue_drop();
+            }
+            outbox->pending.emplace_back(slab, (uint32_t)count);
+            if (!outbox->writing) {
+                self->flush_tcp_outbox(socket, outbox);
+            }
+        });
+}
+
+void network_manager::flush_tcp_outbox(std::shared_ptr<tcp_socket> peer, std::shared_ptr<tcp_outbox_t> outbox)
+{
+    outbox->writing = true;
+    outbox->inflight = std::move(outbox->pending);
+    outbox->pending.clear();
+    outbox->sizes.clear();
+    outbox->sizes.reserve(outbox->inflight.size());
+
+    // One [cmd][size][payload] triple per quantum, all gathered into a
+    // single write so a burst of coalesced quanta costs one syscall
+    static const uint32_t audio_cmd = (uint32_t)cmd_t::cmd_audio_data;
+    std::vector<asio::const_buffer> gather;
+    gather.reserve(outbox->inflight.size() * 3);
+    for (const auto& [slab, size] : outbox->inflight) {
+        outbox->sizes.push_back(size);
+        gather.push_back(asio::buffer(&audio_cmd, sizeof(audio_cmd)));
+        gather.push_back(asio::buffer(&outbox->sizes.back(), sizeof(uint32_t)));
+        gather.push_back(asio::buffer(slab->data(), size));
+    }
+
+    asio::async_write(*peer, gather,
+        asio::bind_executor(outbox->executor,
+            [self = shared_from_this(), peer, outbox](std::error_code ec, size_t) {
+                const size_t flushed = outbox->inflight.size();
+                outbox->inflight.clear();
+                outbox->sizes.clear();
+                if (ec) {
+                    // Leave writing set so no further gathers are started;
+                    // the heartbeat sweep reaps the dead socket
+                    audio_share::metrics::instance().on_send_error();
+                    AUDIO_SHARE_LOG_EVERY_MS(spdlog::level::trace, 1000, "tcp stream write error: {}", ec.message());
+                    return;
+                }
+                audio_share::metrics::instance().on_segments_sent(flushed);
+                if (!outbox->pending.empty()) {
+                    self->flush_tcp_outbox(peer, outbox);
+                } else {
+                    outbox->writing = false;
+                }
+            }));
+}
+
+void network_manager::segment_and_flush(const audio_share::buffer_pool::buffer_ptr& slab, size_t count, int block_align, const std::vector<udp_target_t>& udp_peers, int max_payload)
+{
+    if (udp_peers.empty()) {
+        return;
+    }
+
+    // divide udp frame using the group's path MTU budget
+    int max_seg_size = max_payload;
+    max_seg_size -= max_seg_size % block_align; // one single sample can't be divided
+
+    flush_udp_batch(slab, plan_segments(count, max_seg_size), udp_peers);
+}
+
+const std::vector<network_manager::seg_view>& network_manager::plan_segments(size_t count, int max_seg_size)
+{
+    // Segments are (offset, length) views into the slab, no per-segment
+    // copy. The plan only depends on (count, budget), both stable across
+    // quanta, so the cached list is reused until either changes; a rebuild
+    // reuses the vector's capacity, keeping steady state allocation-free.
+    auto& plan = _seg_plans[max_seg_size];
+    if (plan.count != count) {
+        plan.count = count;
+        plan.segs.clear();
+        for (size_t begin_pos = 0; begin_pos < count;) {
+            const size_t real_seg_size = std::min(count - begin_pos, static_cast<size_t>(max_seg_size));
+            plan.segs.push_back({ begin_pos, real_seg_size });
+            begin_pos += real_seg_size;
+        }
+    }
+    return plan.segs;
+}
+
+void network_manager::segment_and_flush_v2(const audio_share::buffer_pool::buffer_ptr& slab, size_t count, int block_align, const std::vector<udp_target_t>& udp_peers, uint64_t capture_us, v2_stream_state_t& stream, uint16_t fec_k, int max_payload)
+{
+    if (udp_peers.empty()) {
+        return;
+    }
+
+    // The header rides in the same datagram, so the payload budget shrinks
+    // accordingly to stay under the path MTU
+    int max_seg_size = max_payload - (int)sizeof(frame_header_v2);
+    max_seg_size -= max_seg_size % block_align; // one single sample can't be divided
+
+    const auto& seg_list = plan_segments(count, max_seg_size);
+
+    // One header per segment; the send gathers header and payload with
+    // scatter/gather I/O, so no byte of PCM is copied for the framing. The
+    // headers share ownership with the slab until the last send completes.
+    auto headers = std::make_shared<std::vector<frame_header_v2>>();
+    headers->reserve(seg_list.size());
+    for (size_t i = 0; i < seg_list.size(); ++i) {
+        headers->push_back({ stream.seq++, capture_us, 0, fec_k });
+    }
+
+    flush_udp_batch(slab, seg_list, udp_peers, headers);
+
+    if (fec_k < FEC_MIN_K) {
+        return;
+    }
+
+    // Fold this quantum's segments into the running parity. The accumulator
+    // persists across quanta, so the parity cadence is exactly one packet
+    // per K data segments regardless of segments per quantum.
+    for (size_t i = 0; i < seg_list.size(); ++i) {
+        const auto& seg = seg_list[i];
+        if (stream.fec_count == 0) {
+            stream.fec_first_seq = (*headers)[i].seq;
+            stream.fec_len_xor = 0;
+            stream.fec_parity.clear();
+        }
+        if (stream.fec_parity.size() < seg.len) {
+            // Growing zero-fills, which is exactly the XOR padding we need
+            stream.fec_parity.resize(seg.len, 0);
+        }
+        xor_fold(stream.fec_parity.data(), slab->data() + seg.offset, seg.len);
+        stream.fec_len_xor ^= (uint16_t)seg.len;
+        ++stream.fec_count;
+
+        if (stream.fec_count == fec_k) {
+            // Emit the parity packet: [len_xor:u16][parity bytes], header
+            // carries the first protected seq and the parity flag
+            const size_t parity_len = sizeof(uint16_t) + stream.fec_parity.size();
+            auto parity_slab = _slab_pool->acquire(parity_len);
+            std::memcpy(parity_slab->data(), &stream.fec_len_xor, sizeof(uint16_t));
+            std::memcpy(parity_slab->data() + sizeof(uint16_t), stream.fec_parity.data(), stream.fec_parity.size());
+
+            auto parity_headers = std::make_shared<std::vector<frame_header_v2>>();
+            parity_headers->push_back({ stream.fec_first_seq, capture_us, FRAME_FLAG_FEC_PARITY, fec_k });
+
+            const std::vector<seg_view> parity_segs { { 0, parity_len } };
+            flush_udp_batch(parity_slab, parity_segs, udp_peers, parity_headers);
+
+            stream.fec_count = 0;
+        }
+    }
+}
+
+void network_manager::flush_udp_batch(const audio_share::buffer_pool::buffer_ptr& slab, const std::vector<seg_view>& seg_list, const std::vector<udp_target_t>& udp_peers,
+    const std::shared_ptr<std::vector<frame_header_v2>>& headers)
+{
+    if (seg_list.empty() || udp_peers.empty()) {
+        return;
+    }
+
+    // With pacing enabled, release the first train now and hand the rest to
+    // the timer, spread evenly across the quantum duration. A pacer that has
+    // fallen behind sends immediately instead of growing latency; SO_TXTIME
+    // would move the release into the kernel but needs an etf qdisc on the
+    // egress interface, so the portable single-timer path is used.
+    if (_pace_trains > 1 && _pace_quantum_us > 0 && seg_list.size() > 1
+        && (int)_pace_queue.size() < MAX_PACE_PENDING_BATCHES) {
+        const size_t trains = std::min<size_t>((size_t)_pace_trains, seg_list.size());
+        const size_t per_train = (seg_list.size() + trains - 1) / trains;
+        send_udp_segments(slab, seg_list.data(), per_train, udp_peers, headers, 0);
+
+        pace_batch_t batch;
+        batch.slab = slab;
+        batch.seg_list = seg_list;
+        batch.targets = udp_peers;
+        batch.headers = headers;
+        batch.next_seg = per_train;
+        batch.per_train = per_train;
+        batch.interval = std::chrono::microseconds(_pace_quantum_us / trains);
+        _pace_queue.push_back(std::move(batch));
+
+        if (_pace_queue.size() == 1 && _pace_timer) {
+            _pace_timer->expires_after(_pace_queue.front().interval);
+            _pace_timer->async_wait([self = shared_from_this()](const asio::error_code& ec) {
+                if (!ec) {
+                    self->pace_timer_tick();
+                }
+            });
+        }
+        return;
+    }
+
+    send_udp_segments(slab, seg_list.data(), seg_list.size(), udp_peers, headers, 0);
+}
+
+void network_manager::pace_timer_tick()
+{
+    if (_pace_queue.empty()) {
+        return;
+    }
+
+    auto& batch = _pace_queue.front();
+    const size_t n = std::min(batch.per_train, batch.seg_list.size() - batch.next_seg);
+    send_udp_segments(batch.slab, batch.seg_list.data() + batch.next_seg, n, batch.targets, batch.headers, batch.next_seg);
+    batch.next_seg += n;
+    if (batch.next_seg >= batch.seg_list.size()) {
+        _pace_queue.pop_front();
+    }
+
+    if (!_pace_queue.empty() && _pace_timer) {
+        _pace_timer->expires_after(_pace_queue.front().interval);
+        _pace_timer->async_wait([self = shared_from_this()](const asio::error_code& ec) {
+            if (!ec) {
+                self->pace_timer_tick();
+            }
+        });
+    }
+}
+
+void network_manager::send_udp_segments(const audio_share::buffer_pool::buffer_ptr& slab, const seg_view* segs, size_t seg_count, const std::vector<udp_target_t>& udp_peers,
+    const std::shared_ptr<std::vector<frame_header_v2>>& headers, size_t header_base)
+{
+    if (seg_count == 0 || udp_peers.empty()) {
+        return;
+    }
+
+#ifdef linux
+    // Gather every (segment, endpoint) pair of this quantum and flush them
+    // with a single sendmmsg() on the native handle, so syscall count scales
+    // with quanta instead of clients x segments.
+    const size_t total = seg_count * udp_peers.size();
+    // With v2 framing each message gathers [header][payload]; v1 keeps a
+    // single iovec per message
+    const size_t iov_per_msg = headers ? 2 : 1;
+    std::vector<iovec> iovs(total * iov_per_msg);
+    std::vector<mmsghdr> msgs(total);
+
+    size_t idx = 0;
+    for (size_t s = 0; s < seg_count; ++s) {
+        const auto& seg = segs[s];
+        for (const auto& target : udp_peers) {
+            iovec* iov = &iovs[idx * iov_per_msg];
+            if (headers) {
+                iov[0] = { (void*)&(*headers)[header_base + s], sizeof(frame_header_v2) };
+                iov[1] = { (void*)(slab->data() + seg.offset), seg.len };
+            } else {
+                iov[0] = { (void*)(slab->data() + seg.offset), seg.len };
+            }
+            msgs[idx].msg_hdr = {};
+            msgs[idx].msg_hdr.msg_name = (void*)target.endpoint.data();
+            msgs[idx].msg_hdr.msg_namelen = (socklen_t)target.endpoint.size();
+            msgs[idx].msg_hdr.msg_iov = iov;
+            msgs[idx].msg_hdr.msg_iovlen = iov_per_msg;
+            ++idx;
+        }
+    }
+
+#ifdef AUDIO_SHARE_HAS_URING
+    if (_uring_sender) {
+        // Hand the whole fan-out to the ring in one io_uring_enter; the
+        // batch pins the slab and headers until the completions arrive. A
+        // full ring falls through to the sendmmsg loop below.
+        std::vector<audio_share::uring_sender::packet_t> packets(total);
+        for (size_t i = 0; i < total; ++i) {
+            packets[i] = {
+                msgs[i].msg_hdr.msg_iov,
+                (size_t)msgs[i].msg_hdr.msg_iovlen,
+                (const sockaddr*)msgs[i].msg_hdr.msg_name,
+                msgs[i].msg_hdr.msg_namelen,
+            };
+        }
+        auto keep_alive = std::make_shared<std::pair<audio_share::buffer_pool::buffer_ptr, std::shared_ptr<std::vector<frame_header_v2>>>>(slab, headers);
+        if (_uring_sender->submit(packets, keep_alive)) {
+            return;
+        }
+    }
+#endif
+
+    size_t sent = 0;
+    while (sent < total) {
+        int n = ::sendmmsg(_udp_server->native_handle(), msgs.data() + sent, (unsigned)(total - sent), 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // Socket buffer full: hand the remainder back to asio so it is
+                // flushed when the socket becomes writable again. The slab is
+                // captured so its bytes outlive the async sends. The handler
+                // count is bounded; beyond the cap the stale remainder is
+                // dropped so a saturated socket can never grow the io_context
+                // queue or pin unbounded slabs.
+                for (size_t i = sent; i < total; ++i) {
+                    if (_udp_inflight.load(std::memory_order_relaxed) >= MAX_UDP_INFLIGHT_SEGMENTS) {
+                        audio_share::metrics::instance().on_queue_drop();
+                        continue;
+                    }
+                    const size_t s = i / udp_peers.size();
+                    const auto& seg = segs[s];
+                    const auto& target = udp_peers[i % udp_peers.size()];
+                    _udp_inflight.fetch_add(1, std::memory_order_relaxed);
+                    auto done = [self = shared_from_this(), slab, headers](const asio::error_code& ec, std::size_t) {
+                        self->_udp_inflight.fetch_sub(1, std::memory_order_relaxed);
+                        if (ec) {
+                            audio_share::metrics::instance().on_send_error();
+                            AUDIO_SHARE_LOG_EVERY_MS(spdlog::level::trace, 1000, "UDP send error: {}", ec.message());
+                        } else {
+                            audio_share::metrics::instance().on_segments_sent(1);
+                        }
+                    };
+                    if (headers) {
+                        std::array<asio::const_buffer, 2> gather = {
+                            asio::buffer(&(*headers)[header_base + s], sizeof(frame_header_v2)),
+                            asio::buffer(slab->data() + seg.offset, seg.len),
+                        };
+                        _udp_server->async_send_to(gather, target.endpoint, done);
+                    } else {
+                        _udp_server->async_send_to(asio::buffer(slab->data() + seg.offset, seg.len), target.endpoint, done);
+                    }
+                }
+                return;
+            }
+            audio_share::metrics::instance().on_send_error();
+            AUDIO_SHARE_LOG_EVERY_MS(spdlog::level::trace, 1000, "sendmmsg error: {}", strerror(errno));
+            return;
+        }
+        audio_share::metrics::instance().on_segments_sent((uint64_t)n);
+        sent += n;
+    }
+#else
+    // No sendmmsg on this platform, keep the per-packet async path. The
+    // in-flight cap bounds handler queue growth when the socket is slow.
+    for (size_t s = 0; s < seg_count; ++s) {
+        const auto& seg = segs[s];
+        for (const auto& target : udp_peers) {
+            if (_udp_inflight.load(std::memory_order_relaxed) >= MAX_UDP_INFLIGHT_SEGMENTS) {
+                audio_share::metrics::instance().on_queue_drop();
+                continue;
+            }
+            _udp_inflight.fetch_add(1, std::memory_order_relaxed);
+            auto done = [self = shared_from_this(), slab, headers](const asio::error_code& ec, std::size_t) {
+                self->_udp_inflight.fetch_sub(1, std::memory_order_relaxed);
+                if (ec) {
+                    audio_share::metrics::instance().on_send_error();
+                    AUDIO_SHARE_LOG_EVERY_MS(spdlog::level::trace, 1000, "UDP send error: {}", ec.message());
+                } else {
+                    audio_share::metrics::instance().on_segments_sent(1);
+                }
+            };
+            if (headers) {
+                std::array<asio::const_buffer, 2> gather = {
+                    asio::buffer(&(*headers)[header_base + s], sizeof(frame_header_v2)),
+                    asio::buffer(slab->data() + seg.offset, seg.len),
+                };
+                _udp_server->async_send_to(gather, target.endpoint, done);
+            } else {
+                _udp_server->async_send_to(asio::buffer(slab->data() + seg.offset, seg.len), target.endpoint, done);
+            }
+        }
+    }
+#endif
+}
+
+void network_manager::add_broadcaster(std::shared_ptr<audio_broadcaster> broadcaster)
+{
+    std::lock_guard<std::mutex> lock(_broadcasters_mutex);
+    _additional_broadcasters.push_back(broadcaster);
+    spdlog::info("Added additional broadcaster, total: {}", _additional_broadcasters.size());
+}
@@ -20,7 +20,9 @@
 #include <memory>
 #include <vector>
 #include <string>
+#include <deque>
 #include <map>
+#include <unordered_map>
 #include <mutex>
 #include <atomic>
 
@@ -29,6 +31,17 @@
 #include <asio/use_awaitable.hpp>
 
 #include "buffer_pool.hpp"
+#include "flight_recorder.hpp"
+#include "sample_rate_converter.hpp"
+#include "shm_transport.hpp"
+#include "socket_tuning.hpp"
+#include "spsc_ring.hpp"
+#ifdef AUDIO_SHARE_HAS_OPUS
+#include "opus_stream_encoder.hpp"
+#endif
+#ifdef AUDIO_SHARE_HAS_URING
+#include "uring_sender.hpp"
+#endif
 
 #include "audio_broadcaster.hpp"
 #include "audio_manager.hpp"
@@ -42,19 +55,91 @@ class network_manager : public audio_broadcaster, public std::enable_shared_from
     using udp_socket = default_token::as_default_on_t<asio::ip::udp::socket>;
     using steady_timer = default_token::as_default_on_t<asio::steady_timer>;
 
+    // Codec a peer receives its UDP payload in, negotiated via cmd_set_codec
+    enum class audio_codec_t : uint32_t {
+        codec_raw = 0,
+        codec_opus = 1,
+    };
+
+    // Per-peer coalescing outbox for the TCP streaming fallback. All fields
+    // are touched only on the peer's strand: quanta pile into pending while
+    // a gather write is in flight, and the completion flushes everything
+    // accumulated as one async_write, keeping syscalls per second flat.
+    struct tcp_outbox_t {
+        asio::any_io_executor executor;  // The peer's strand
+        std::vector<std::pair<audio_share::buffer_pool::buffer_ptr, uint32_t>> pending;
+        std::vector<std::pair<audio_share::buffer_pool::buffer_ptr, uint32_t>> inflight;  // Keeps the slabs alive during the write
+        std::vector<uint32_t> sizes;  // Length prefixes referenced by the in-flight gather
+        bool writing = false;
+    };
+
     struct peer_info_t {
         int id = 0;
         asio::ip::udp::endpoint udp_peer;
+        audio_codec_t codec = audio_codec_t::codec_raw;
+        // Per-peer PCM encoding; encoding_default means the capture format as-is
+        audio_manager::encoding_t encoding = audio_manager::encoding_t::encoding_default;
+        // Per-peer output rate in Hz, 0 = capture rate as-is
+        int sample_rate = 0;
+        // Peer listens on the multicast group instead of a unicast endpoint
+        bool multicast = false;
+        // Peer requested v2 frames (frame_header_v2 before the payload)
+        bool frame_v2 = false;
+        // XOR parity group size, 0 = FEC off; only meaningful with frame_v2
+        uint16_t fec_k = 0;
+        // The group size the client asked for on cmd_start_play; the
+        // adaptive controller recovers toward this after a lossy spell
+        uint16_t fec_k_base = 0;
+        // Adaptive quality controller state, fed by cmd_heartbeat_stats
+        uint32_t hb_high_seq = 0;    // Client's received-seq high-water mark
+        uint32_t hb_lost = 0;        // Client's cumulative loss count
+        bool hb_seen = false;        // First report only seeds the baselines
+        int hb_clean_intervals = 0;  // Loss-free reports since the last protection step
+        // Peer reads the shared-memory ring instead of receiving UDP
+        bool shm = false;
+        // Peer never registered a UDP endpoint and receives length-prefixed
+        // frames on the control socket instead
+        bool tcp_stream = false;
+        std::shared_ptr<tcp_outbox_t> tcp_outbox;
+        // UDP payload budget from path MTU discovery; worst-case until probed
+        int udp_payload = audio_share::constants::MAX_UDP_PAYLOAD_SIZE;
+        // qwave flow on the UDP server socket (Windows QoS), 0 = none
+        uint32_t qos_flow_id = 0;
+        // Fast-resume token handed out on cmd_start_play (0 = none); on
+        // disconnect the negotiated state is parked in _resume_cache under
+        // this key so a roaming client can skip renegotiation
+        uint64_t session_token = 0;
+        // Strand the peer's control coroutines run on; heartbeat writes
+        // from the sweep join it so socket writes stay serialized
+        asio::any_io_executor executor;
         // Use atomic for thread-safe access to last_tick
         std::atomic<std::chrono::steady_clock::time_point> last_tick{std::chrono::steady_clock::now()};
-        
+
         peer_info_t() = default;
-        peer_info_t(const peer_info_t& other) 
-            : id(other.id), udp_peer(other.udp_peer), last_tick(other.last_tick.load()) {}
+        peer_info_t(const peer_info_t& other)
+            : id(other.id), udp_peer(other.udp_peer), codec(other.codec), encoding(other.encoding), sample_rate(other.sample_rate), multicast(other.multicast), frame_v2(other.frame_v2), fec_k(other.fec_k), fec_k_base(other.fec_k_base), hb_high_seq(other.hb_high_seq), hb_lost(other.hb_lost), hb_seen(other.hb_seen), hb_clean_intervals(other.hb_clean_intervals), shm(other.shm), tcp_stream(other.tcp_stream), tcp_outbox(other.tcp_outbox), udp_payload(other.udp_payload), qos_flow_id(other.qos_flow_id), session_token(other.session_token), executor(other.executor), last_tick(other.last_tick.load()) {}
         peer_info_t& operator=(const peer_info_t& other) {
             if (this != &other) {
                 id = other.id;
                 udp_peer = other.udp_peer;
+                codec = other.codec;
+                encoding = other.encoding;
+                sample_rate = other.sample_rate;
+                multicast = other.multicast;
+                frame_v2 = other.frame_v2;
+                fec_k = other.fec_k;
+                fec_k_base = other.fec_k_base;
+                hb_high_seq = other.hb_high_seq;
+                hb_lost = other.hb_lost;
+                hb_seen = other.hb_seen;
+                hb_clean_intervals = other.hb_clean_intervals;
+                shm = other.shm;
+                tcp_stream = other.tcp_stream;
+                tcp_outbox = other.tcp_outbox;
+                udp_payload = other.udp_payload;
+                qos_flow_id = other.qos_flow_id;
+                session_token = other.session_token;
+                executor = other.executor;
                 last_tick.store(other.last_tick.load());
             }
             return *this;
@@ -63,12 +148,134 @@ class network_manager : public audio_broadcaster, public std::enable_shared_from
 
     using playing_peer_list_t = std::map<std::shared_ptr<tcp_socket>, std::shared_ptr<peer_info_t>>;
 
+    // Immutable UDP fan-out target, published as part of a peer snapshot.
+    struct udp_target_t {
+        int id = 0;
+        asio::ip::udp::endpoint endpoint;
+    };
+
+    // PCM targets sharing one negotiated encoding and frame version; the
+    // quantum is converted and framed once per group, never per client.
+    struct target_group_t {
+        audio_manager::encoding_t encoding = audio_manager::encoding_t::encoding_default;
+        int sample_rate = 0;  // Output rate shared by this group, 0 = capture rate
+        bool frame_v2 = false;
+        uint16_t fec_k = 0;  // Parity group size shared by this whole group, 0 = no FEC
+        int max_payload = audio_share::constants::MAX_UDP_PAYLOAD_SIZE;  // Per-path UDP payload budget shared by this group
+        std::vector<udp_target_t> targets;
+    };
+
+    // TCP streaming fallback target: the peer's control socket carries
+    // [cmd_audio_data:u32][size:u32][payload] frames instead of UDP segments
+    struct tcp_target_t {
+        int id = 0;
+        std::shared_ptr<tcp_socket> socket;
+        audio_manager::encoding_t encoding = audio_manager::encoding_t::encoding_default;
+        std::shared_ptr<tcp_outbox_t> outbox;
+    };
+
+    // Snapshot of all registered UDP targets, grouped by negotiated codec and
+    // encoding. Broadcasters load it lock-free; membership changes build and
+    // publish a fresh snapshot on the control path.
+    struct peer_snapshot_t {
+        std::vector<target_group_t> pcm_groups;
+        std::vector<udp_target_t> opus_targets;
+#ifdef AUDIO_SHARE_HAS_OPUS
+        // The shared encoder rides in the snapshot so broadcasters pick it
+        // up with the same release/acquire ordering as the target lists;
+        // encode state is still touched only on the broadcast strand
+        std::shared_ptr<audio_share::opus_stream_encoder> opus_encoder;
+#endif
+        // Holds the multicast group endpoint while at least one peer listens
+        // on the group, so each segment is sent to the group exactly once
+        std::vector<udp_target_t> multicast_targets;
+        // Same-host peers reading the shared-memory ring; the quantum is
+        // written into the ring once while this is non-zero
+        int shm_consumers = 0;
+        // Peers streaming over their control socket because their UDP
+        // registration never arrived (firewalled UDP)
+        std::vector<tcp_target_t> tcp_targets;
+    };
+
     enum class cmd_t : uint32_t {
         cmd_none = 0,
         cmd_get_format = 1,
         cmd_start_play = 2,
         cmd_heartbeat = 3,
+        cmd_set_codec = 4,
+        cmd_set_encoding = 5,
+        cmd_get_stats = 6,
+        cmd_set_sample_rate = 7,
+        cmd_audio_data = 8,  // Server -> client: one length-prefixed quantum on the TCP fallback
+        cmd_dump_recorder = 9,  // Snapshot the flight recorder ring; reply carries the dump path
+        // Heartbeat variant carrying the client's received-seq high-water
+        // mark and cumulative loss count (u32 each); feeds the per-peer
+        // adaptive quality controller. Counts as a heartbeat.
+        cmd_heartbeat_stats = 10,
+        // Client presents its session token (u64) to restore the previous
+        // negotiated state in one round trip; reply id 0 means the token
+        // expired and the client does the full handshake instead
+        cmd_resume_play = 11,
+    };
+
+    // Capability bits a client may set on cmd_start_play; the server echoes
+    // back only the ones it can honor
+    constexpr static uint32_t CMD_FLAG_MULTICAST = 0x80000000u;
+    constexpr static uint32_t CMD_FLAG_FRAME_V2 = 0x40000000u;
+    constexpr static uint32_t CMD_FLAG_FEC = 0x20000000u;  // Client appends its requested K (u32) to cmd_start_play
+    constexpr static uint32_t CMD_FLAG_SHM = 0x10000000u;  // Granted only to loopback peers; reply appends the region name
+    constexpr static uint32_t CMD_FLAG_RESUME = 0x08000000u;  // Reply appends a session token (u64) for cmd_resume_play
+    constexpr static uint32_t CMD_FLAG_COMPACT_FORMAT = 0x04000000u;  // cmd_get_format replies with wire_format_t instead of the protobuf
+    constexpr static uint32_t CMD_FLAG_MASK = CMD_FLAG_MULTICAST | CMD_FLAG_FRAME_V2 | CMD_FLAG_FEC | CMD_FLAG_SHM | CMD_FLAG_RESUME | CMD_FLAG_COMPACT_FORMAT;
+
+    // v2 UDP frame header, prepended to every segment for peers that opted
+    // in. Little endian on the wire, like the PCM payload. fec_k tells the
+    // client the parity group size (0 = no FEC on this stream); a parity
+    // packet carries the seq of the first data segment it protects.
+#pragma pack(push, 1)
+    struct frame_header_v2 {
+        uint32_t seq;
+        uint64_t capture_us;
+        uint16_t flags;
+        uint16_t fec_k;
+    };
+#pragma pack(pop)
+
+    constexpr static uint16_t FRAME_FLAG_FEC_PARITY = 0x0001;
+
+    // Fixed-layout format reply for clients built without protobuf: set
+    // CMD_FLAG_COMPACT_FORMAT on cmd_get_format and the reply payload is
+    // this struct instead of the serialized AudioFormat. Encoding uses the
+    // AudioFormat::Encoding numbering (asserted in the handler so the two
+    // descriptions cannot drift); little endian on the wire.
+#pragma pack(push, 1)
+    struct wire_format_t {
+        uint16_t version;        // Highest UDP frame version the server speaks
+        uint16_t encoding;       // AudioFormat::Encoding value
+        uint16_t channels;
+        uint16_t block_align;    // Bytes per frame across all channels
+        uint32_t sample_rate;
+        uint32_t resample_rate;  // Granted per-connection rate, 0 = sample_rate
     };
+#pragma pack(pop)
+    static_assert(sizeof(wire_format_t) == 16, "compact format reply is fixed at 16 bytes");
+
+    // Per-group v2 stream state: the sequence counter plus the running XOR
+    // parity accumulator. A parity packet protects the K preceding data
+    // segments; its payload is [len_xor:u16] followed by the XOR of the
+    // payloads zero-padded to the longest, so a client holding K-1 of them
+    // recovers the missing segment and its length with no round trip.
+    struct v2_stream_state_t {
+        uint32_t seq = 0;
+        uint32_t fec_count = 0;      // Data segments folded into the parity so far
+        uint32_t fec_first_seq = 0;  // Seq of the first protected segment
+        uint16_t fec_len_xor = 0;
+        std::vector<uint8_t> fec_parity;
+    };
+
+    // Bounds for the per-peer FEC group size requested on cmd_start_play
+    constexpr static uint32_t FEC_MIN_K = 2;
+    constexpr static uint32_t FEC_MAX_K = 16;
 
 public:
 
@@ -85,20 +292,138 @@ public:
     void wait_server();
     bool is_running() const;
 
+    /**
+     * @brief Set the io_context thread pool size before start_server.
+     *        0 selects the default of min(4, hardware_concurrency).
+     */
+    void set_net_thread_count(int count) { _net_thread_count = count; }
+
+    /**
+     * @brief Enable the opt-in multicast streaming mode before start_server.
+     *        Capable clients are handed the group on cmd_start_play and each
+     *        segment is sent once to the group instead of once per peer.
+     * @param group An IPv4 multicast group address, e.g. "239.77.77.77"
+     * @param port The UDP port clients listen on for the group traffic
+     */
+    void set_multicast(const std::string& group, uint16_t port);
+
+    /**
+     * @brief Set the silence gate hangover before start_server. All-zero
+     *        quanta older than the hangover are not broadcast; a one-frame
+     *        keepalive quantum is emitted instead so clients hold their
+     *        jitter buffers. 0 disables the gate.
+     * @param ms Hangover in milliseconds
+     */
+    void set_silence_hangover(int ms) { _silence_hangover_ms = ms; }
+
+    /**
+     * @brief Set socket tuning and QoS marking before start_server. Applied
+     *        to the UDP server socket at startup and to each accepted TCP
+     *        peer; effective values are logged.
+     */
+    void set_socket_tuning(const audio_share::socket_tuner::config_t& config) { _tuning_config = config; }
+
+    /**
+     * @brief Spread each quantum's UDP segments over @p trains timed
+     *        releases instead of one burst, bounding instantaneous line
+     *        rate at the cost of under one quantum of added latency.
+     *        0 or 1 sends every segment immediately (the default).
+     */
+    void set_pacing(int trains) { _pace_trains = trains; }
+
 private:
     asio::awaitable<void> accept_tcp_loop(tcp_acceptor acceptor);
     asio::awaitable<void> read_loop(std::shared_ptr<tcp_socket> peer);
-    asio::awaitable<void> heartbeat_loop(std::shared_ptr<tcp_socket> peer);
+    // One sweep per HEARTBEAT_INTERVAL services every playing peer: a
+    // single timer and a single _peer_list_mutex acquisition per tick
+    // instead of one heartbeat coroutine per peer
+    asio::awaitable<void> heartbeat_sweep_loop();
+    asio::awaitable<void> send_heartbeat(std::shared_ptr<tcp_socket> peer);
     asio::awaitable<void> accept_udp_loop();
-    
+    // Armed on cmd_start_play for unicast peers: when no UDP registration
+    // arrives within TCP_FALLBACK_TIMEOUT, the peer is switched to
+    // length-prefixed frames on its control socket
+    asio::awaitable<void> udp_fallback_watch(std::shared_ptr<tcp_socket> peer);
+#ifdef linux
+    // SIGUSR1 snapshots the flight recorder to disk, so a field problem can
+    // be captured without a client issuing cmd_dump_recorder
+    asio::awaitable<void> dump_signal_loop();
+#endif
+
     playing_peer_list_t::iterator close_session(std::shared_ptr<tcp_socket>& peer);
-    int add_playing_peer(std::shared_ptr<tcp_socket>& peer);
+    int add_playing_peer(std::shared_ptr<tcp_socket>& peer, bool multicast, bool frame_v2, uint16_t fec_k, bool shm, asio::any_io_executor executor);
+    // Restore a recently disconnected peer's negotiated state from the
+    // resume cache; returns nullptr when the token is unknown or expired
+    std::shared_ptr<peer_info_t> resume_playing_peer(std::shared_ptr<tcp_socket>& peer, uint64_t token, asio::any_io_executor executor);
     playing_peer_list_t::iterator remove_playing_peer(std::shared_ptr<tcp_socket>& peer);
     void fill_udp_peer(int id, asio::ip::udp::endpoint udp_peer);
+    void publish_peer_snapshot();  // Caller must hold _peer_list_mutex
+
+    // Path MTU probe for one peer, derived from the kernel route cache on a
+    // connected throwaway socket. Returns the usable UDP payload size, or
+    // the worst-case constant where probing is unsupported.
+    static int probe_udp_payload(const asio::ip::udp::endpoint& peer);
 
 public:
     void broadcast_audio_data(const char* data, size_t count, int block_align) override;
-    
+
+private:
+    // A segment is an (offset, length) view into the quantum slab; the slab's
+    // shared_ptr keeps the bytes alive until the last send completes.
+    struct seg_view {
+        size_t offset;
+        size_t len;
+    };
+
+    // Cached segmentation plan. Quantum size and payload budget are stable
+    // for long stretches, so the (offset, length) list is identical every
+    // quantum; rebuilding it only when either changes keeps the steady-state
+    // broadcast path free of allocation and boundary math. One plan per
+    // distinct payload budget, touched only on the broadcast strand.
+    struct seg_plan_t {
+        size_t count = 0;
+        std::vector<seg_view> segs;
+    };
+
+    // Remainder of a paced quantum waiting for its next timed release. The
+    // target list is copied out of the snapshot so the batch stays valid
+    // after the snapshot it came from is republished. Touched only on the
+    // broadcast strand.
+    struct pace_batch_t {
+        audio_share::buffer_pool::buffer_ptr slab;
+        std::vector<seg_view> seg_list;
+        std::vector<udp_target_t> targets;
+        std::shared_ptr<std::vector<frame_header_v2>> headers;
+        size_t next_seg = 0;   // First segment not yet released
+        size_t per_train = 0;  // Segments per release
+        std::chrono::microseconds interval {};
+    };
+
+    void drain_capture_ring();
+    void broadcast_quantum(const audio_share::buffer_pool::buffer_ptr& slab, size_t count, int block_align, uint64_t capture_us);
+    void segment_and_flush(const audio_share::buffer_pool::buffer_ptr& slab, size_t count, int block_align, const std::vector<udp_target_t>& udp_peers, int max_payload);
+    void segment_and_flush_v2(const audio_share::buffer_pool::buffer_ptr& slab, size_t count, int block_align, const std::vector<udp_target_t>& udp_peers, uint64_t capture_us, v2_stream_state_t& stream, uint16_t fec_k, int max_payload);
+    void flush_udp_batch(const audio_share::buffer_pool::buffer_ptr& slab, const std::vector<seg_view>& seg_list, const std::vector<udp_target_t>& udp_peers,
+        const std::shared_ptr<std::vector<frame_header_v2>>& headers = nullptr);
+    // The actual fan-out for a run of segments; header index i pairs with
+    // segment header_base + i so a paced remainder keeps its v2 sequencing
+    void send_udp_segments(const audio_share::buffer_pool::buffer_ptr& slab, const seg_view* segs, size_t seg_count, const std::vector<udp_target_t>& udp_peers,
+        const std::shared_ptr<std::vector<frame_header_v2>>& headers, size_t header_base);
+    void pace_timer_tick();  // Runs on the broadcast strand
+    const std::vector<seg_view>& plan_segments(size_t count, int max_seg_size);  // Caller must be on the broadcast strand
+    void enqueue_tcp_frame(const tcp_target_t& target, const audio_share::buffer_pool::buffer_ptr& slab, size_t count);
+    void flush_tcp_outbox(std::shared_ptr<tcp_socket> peer, std::shared_ptr<tcp_outbox_t> outbox);  // Caller must be on the peer's strand
+    bool set_peer_codec(const std::shared_ptr<tcp_socket>& peer, audio_codec_t codec);
+    bool set_peer_encoding(const std::shared_ptr<tcp_socket>& peer, audio_manager::encoding_t encoding);
+    bool set_peer_sample_rate(const std::shared_ptr<tcp_socket>& peer, int sample_rate);
+    // Per-peer quality controller, fed by one cmd_heartbeat_stats report.
+    // Reacts to downstream loss for this peer alone, so one bad Wi-Fi
+    // client never drags everyone to a conservative configuration.
+    // Caller must hold _peer_list_mutex.
+    void adapt_peer_quality(const std::shared_ptr<peer_info_t>& info, uint32_t high_seq, uint32_t lost);
+
+public:
+
     /**
      * @brief Register an additional broadcaster to receive audio data
      * @param broadcaster Shared pointer to the broadcaster
@@ -109,12 +434,68 @@ public:
 
 private:
     std::shared_ptr<audio_manager> _audio_manager;
-    std::thread _net_thread;
+    std::vector<std::thread> _net_threads;  // io_context thread pool
+    int _net_thread_count = 0;  // 0 = default of min(4, hardware_concurrency)
+    // All broadcast work and UDP socket access is serialized on this strand,
+    // so the capture ring keeps a single consumer on the multi-threaded pool
+    std::unique_ptr<asio::strand<asio::io_context::executor_type>> _broadcast_strand;
     std::unique_ptr<udp_socket> _udp_server;
+#ifdef AUDIO_SHARE_HAS_URING
+    std::unique_ptr<audio_share::uring_sender> _uring_sender;  // Runtime-selected transmit backend, used only on the broadcast strand
+#endif
+    // Same-host ring, created when the first loopback peer negotiates
+    // CMD_FLAG_SHM; written only on the broadcast strand
+    std::unique_ptr<audio_share::shm_transport> _shm;
+    // Socket tuning and QoS marking; on Windows it also owns the qwave
+    // handle the per-peer flows hang off
+    audio_share::socket_tuner::config_t _tuning_config;
+    std::unique_ptr<audio_share::socket_tuner> _socket_tuner;
+    // Always-on mmap ring of the last few seconds of broadcast audio;
+    // written only on the broadcast strand, dumped via cmd_dump_recorder
+    // (or SIGUSR1 on Linux)
+    std::unique_ptr<audio_share::flight_recorder> _recorder;
+    asio::ip::address_v4 _multicast_group;  // Unspecified when multicast mode is off
+    uint16_t _multicast_port = 0;
     playing_peer_list_t _playing_peer_list;
-    mutable std::mutex _peer_list_mutex;  // Protects _playing_peer_list
+    // id -> (socket, info) hash index over _playing_peer_list, so UDP
+    // registration datagrams resolve in O(1) instead of scanning the map
+    std::unordered_map<int, std::pair<std::shared_ptr<tcp_socket>, std::shared_ptr<peer_info_t>>> _peer_index;
+    mutable std::mutex _peer_list_mutex;  // Protects _playing_peer_list and _peer_index
+    std::atomic<std::shared_ptr<const peer_snapshot_t>> _peer_snapshot;  // Lock-free view for broadcasters
     constexpr static auto _heartbeat_timeout = audio_share::constants::HEARTBEAT_TIMEOUT;
-    std::unique_ptr<audio_share::buffer_pool> _buffer_pool;  // Buffer pool for UDP packets
+    std::unique_ptr<steady_timer> _heartbeat_timer;  // Drives heartbeat_sweep_loop
+    std::unique_ptr<audio_share::buffer_pool> _slab_pool;  // Pool of quantum slabs shared by all in-flight sends
+    audio_share::spsc_ring _capture_ring { audio_share::constants::CAPTURE_RING_CAPACITY };  // Capture thread -> net thread
+    std::atomic<bool> _drain_scheduled { false };  // True while a drain is posted or running on the net thread
+    std::atomic<int> _udp_inflight { 0 };  // Outstanding async UDP sends, bounded by MAX_UDP_INFLIGHT_SEGMENTS
+    // Transmit pacing, all broadcast-strand-only. One timer services the
+    // queue of paced remainders in FIFO order.
+    int _pace_trains = 0;  // Releases per quantum, <=1 disables pacing
+    uint64_t _pace_quantum_us = 0;  // Duration of the current capture quantum
+    std::unique_ptr<steady_timer> _pace_timer;
+    std::deque<pace_batch_t> _pace_queue;
+    std::unordered_map<int, seg_plan_t> _seg_plans;  // Keyed by payload budget, broadcast strand only
+    // Negotiated state of recently disconnected peers, keyed by session
+    // token and kept for RESUME_CACHE_TTL. Guarded by _peer_list_mutex.
+    struct resume_entry_t {
+        std::shared_ptr<peer_info_t> info;
+        std::chrono::steady_clock::time_point expires;
+    };
+    std::unordered_map<uint64_t, resume_entry_t> _resume_cache;
+    // Silence gate state, touched only on the capture thread
+    int _silence_hangover_ms = audio_share::constants::DEFAULT_SILENCE_HANGOVER_MS;  // 0 = gate disabled
+    bool _silence_suppressing = false;
+    std::chrono::steady_clock::time_point _silence_since {};
+    std::chrono::steady_clock::time_point _silence_last_keepalive {};
+#ifdef AUDIO_SHARE_HAS_OPUS
+    std::shared_ptr<audio_share::opus_stream_encoder> _opus_encoder;  // Created under _peer_list_mutex when the first peer negotiates opus; broadcasters use the snapshot's copy
+#endif
+    // Per-group v2 stream state, touched only on the broadcast strand. The
+    // key mirrors the full group split -- including the path MTU budget --
+    // because two groups sharing a seq counter while each peer only hears
+    // its own group's segments would look like permanent loss downstream.
+    std::map<std::tuple<audio_manager::encoding_t, int, uint16_t, int>, v2_stream_state_t> _v2_streams;
+    std::map<int, std::unique_ptr<audio_share::sample_rate_converter>> _resamplers;  // One converter per distinct granted rate, touched only on the broadcast strand
     std::vector<std::shared_ptr<audio_broadcaster>> _additional_broadcasters;  // Additional broadcasters (e.g., WebSocket)
     mutable std::mutex _broadcasters_mutex;  // Protects _additional_broadcasters
 };
@@ -0,0 +1,104 @@
+/*
+   Copyright 2022-2024 mkckr0 <https://github.com/mkckr0>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifdef AUDIO_SHARE_HAS_OPUS
+
+#include "opus_stream_encoder.hpp"
+
+#include <cstring>
+
+#include <opus.h>
+#include <spdlog/spdlog.h>
+
+namespace audio_share {
+
+// Upper bound for one encoded packet, comfortably above any bitrate we use
+constexpr size_t MAX_OPUS_PACKET_SIZE = 1500;
+
+opus_stream_encoder::opus_stream_encoder(int sample_rate, int channels, input_format format, int bitrate)
+    : _sample_rate(sample_rate)
+    , _channels(channels)
+    , _bitrate(bitrate)
+    , _format(format)
+{
+    int err = OPUS_OK;
+    _encoder = opus_encoder_create(sample_rate, channels, OPUS_APPLICATION_AUDIO, &err);
+    if (err != OPUS_OK) {
+        spdlog::error("opus_encoder_create failed: {} (sample_rate={}, channels={})", opus_strerror(err), sample_rate, channels);
+        _encoder = nullptr;
+        return;
+    }
+
+    opus_encoder_ctl(_encoder, OPUS_SET_BITRATE(bitrate));
+
+    _frame_samples = sample_rate / 100;  // 10 ms
+    const size_t bytes_per_sample = (format == input_format::f32) ? sizeof(float) : sizeof(int16_t);
+    _frame_bytes = (size_t)_frame_samples * channels * bytes_per_sample;
+    _pending.reserve(2 * _frame_bytes);
+}
+
+opus_stream_encoder::~opus_stream_encoder()
+{
+    if (_encoder) {
+        opus_encoder_destroy(_encoder);
+    }
+}
+
+void opus_stream_encoder::encode(const uint8_t* data, size_t count, std::vector<uint8_t>& out, std::vector<packet_t>& packets)
+{
+    if (!_encoder) {
+        return;
+    }
+
+    _pending.insert(_pending.end(), data, data + count);
+
+    size_t consumed = 0;
+    while (_pending.size() - consumed >= _frame_bytes) {
+        const size_t offset = out.size();
+        out.resize(offset + MAX_OPUS_PACKET_SIZE);
+
+        opus_int32 n;
+        const uint8_t* frame = _pending.data() + consumed;
+        if (_format == input_format::f32) {
+            n = opus_encode_float(_encoder, (const float*)frame, _frame_samples, out.data() + offset, MAX_OPUS_PACKET_SIZE);
+        } else {
+            n = opus_encode(_encoder, (const opus_int16*)frame, _frame_samples, out.data() + offset, MAX_OPUS_PACKET_SIZE);
+        }
+        consumed += _frame_bytes;
+
+        if (n < 0) {
+            spdlog::trace("opus_encode error: {}", opus_strerror(n));
+            out.resize(offset);
+            continue;
+        }
+        out.resize(offset + n);
+        packets.emplace_back(offset, (size_t)n);
+    }
+
+    _pending.erase(_pending.begin(), _pending.begin() + consumed);
+}
+
+void opus_stream_encoder::set_bitrate(int bitrate)
+{
+    if (_encoder && bitrate != _bitrate) {
+        opus_encoder_ctl(_encoder, OPUS_SET_BITRATE(bitrate));
+        _bitrate = bitrate;
+    }
+}
+
+} // namespace audio_share
+
+#endif // AUDIO_SHARE_HAS_OPUS
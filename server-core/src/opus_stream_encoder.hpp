@@ -0,0 +1,88 @@
+/*
+   Copyright 2022-2024 mkckr0 <https://github.com/mkckr0>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef OPUS_STREAM_ENCODER_HPP
+#define OPUS_STREAM_ENCODER_HPP
+
+#ifdef AUDIO_SHARE_HAS_OPUS
+
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+struct OpusEncoder;
+
+namespace audio_share {
+
+/**
+ * @brief Streams interleaved PCM quanta through an Opus encoder.
+ *
+ * Capture quanta have arbitrary sizes while Opus needs fixed frames, so the
+ * encoder keeps a small pending buffer and emits one encoded packet per 10 ms
+ * of input. Each packet fits a single UDP datagram, and the same packet is
+ * fanned out to every Opus-capable peer, so the encode cost is paid once per
+ * quantum regardless of client count.
+ */
+class opus_stream_encoder {
+public:
+    enum class input_format {
+        f32,
+        s16,
+    };
+
+    // (offset, length) of an encoded packet inside the output buffer
+    using packet_t = std::pair<size_t, size_t>;
+
+    /**
+     * @brief Create an encoder. Check valid() afterwards: Opus only accepts
+     *        8/12/16/24/48 kHz and mono/stereo input.
+     */
+    opus_stream_encoder(int sample_rate, int channels, input_format format, int bitrate = 128000);
+    ~opus_stream_encoder();
+
+    opus_stream_encoder(const opus_stream_encoder&) = delete;
+    opus_stream_encoder& operator=(const opus_stream_encoder&) = delete;
+
+    bool valid() const { return _encoder != nullptr; }
+
+    /**
+     * @brief Consume one PCM quantum and append any completed packets to @p out
+     * @param data Interleaved PCM in the configured input format
+     * @param count Size of data in bytes
+     * @param out Output buffer the encoded packets are appended to
+     * @param packets Receives one (offset, length) entry per emitted packet
+     */
+    void encode(const uint8_t* data, size_t count, std::vector<uint8_t>& out, std::vector<packet_t>& packets);
+
+    void set_bitrate(int bitrate);
+    int bitrate() const { return _bitrate; }
+
+private:
+    OpusEncoder* _encoder = nullptr;
+    int _sample_rate = 0;
+    int _channels = 0;
+    int _bitrate = 0;
+    input_format _format = input_format::f32;
+    size_t _frame_bytes = 0;  // bytes of PCM per encoded frame (10 ms)
+    int _frame_samples = 0;   // samples per channel per frame
+    std::vector<uint8_t> _pending;  // PCM carried over between quanta
+};
+
+} // namespace audio_share
+
+#endif // AUDIO_SHARE_HAS_OPUS
+#endif // !OPUS_STREAM_ENCODER_HPP
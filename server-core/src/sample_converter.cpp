@@ -0,0 +1,268 @@
+/*
+   Copyright 2022-2024 mkckr0 <https://github.com/mkckr0>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "sample_converter.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define AS_CONVERT_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define AS_CONVERT_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace audio_share {
+
+namespace {
+
+    inline float clamp1(float v)
+    {
+        return std::min(1.0f, std::max(-1.0f, v));
+    }
+
+    // --- scalar kernels -----------------------------------------------------
+
+    void f32_to_s8_scalar(const float* src, size_t n, uint8_t* out)
+    {
+        auto dst = (int8_t*)out;
+        for (size_t i = 0; i < n; ++i) {
+            dst[i] = (int8_t)std::lrintf(clamp1(src[i]) * 127.0f);
+        }
+    }
+
+    void f32_to_s16_scalar(const float* src, size_t n, uint8_t* out)
+    {
+        auto dst = (int16_t*)out;
+        for (size_t i = 0; i < n; ++i) {
+            dst[i] = (int16_t)std::lrintf(clamp1(src[i]) * 32767.0f);
+        }
+    }
+
+    void f32_to_s24_scalar(const float* src, size_t n, uint8_t* out)
+    {
+        // 3-byte little-endian packing has no natural vector form, keep scalar
+        for (size_t i = 0; i < n; ++i) {
+            int32_t v = (int32_t)std::lrintf(clamp1(src[i]) * 8388607.0f);
+            out[3 * i + 0] = (uint8_t)(v & 0xff);
+            out[3 * i + 1] = (uint8_t)((v >> 8) & 0xff);
+            out[3 * i + 2] = (uint8_t)((v >> 16) & 0xff);
+        }
+    }
+
+    void f32_to_s32_scalar(const float* src, size_t n, uint8_t* out)
+    {
+        auto dst = (int32_t*)out;
+        for (size_t i = 0; i < n; ++i) {
+            // 2147483520 = largest multiple of 128 below INT32_MAX that
+            // round-trips through float without overflowing
+            dst[i] = (int32_t)std::lrintf(clamp1(src[i]) * 2147483520.0f);
+        }
+    }
+
+#ifdef AS_CONVERT_X86
+
+    // --- SSE2 kernels (baseline on x86-64) ----------------------------------
+
+    void f32_to_s16_sse2(const float* src, size_t n, uint8_t* out)
+    {
+        auto dst = (int16_t*)out;
+        const __m128 scale = _mm_set1_ps(32767.0f);
+        const __m128 lo = _mm_set1_ps(-1.0f);
+        const __m128 hi = _mm_set1_ps(1.0f);
+
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m128 a = _mm_mul_ps(_mm_min_ps(hi, _mm_max_ps(lo, _mm_loadu_ps(src + i))), scale);
+            __m128 b = _mm_mul_ps(_mm_min_ps(hi, _mm_max_ps(lo, _mm_loadu_ps(src + i + 4))), scale);
+            __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+            _mm_storeu_si128((__m128i*)(dst + i), packed);
+        }
+        f32_to_s16_scalar(src + i, n - i, (uint8_t*)(dst + i));
+    }
+
+    void f32_to_s32_sse2(const float* src, size_t n, uint8_t* out)
+    {
+        auto dst = (int32_t*)out;
+        const __m128 scale = _mm_set1_ps(2147483520.0f);
+        const __m128 lo = _mm_set1_ps(-1.0f);
+        const __m128 hi = _mm_set1_ps(1.0f);
+
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128 a = _mm_mul_ps(_mm_min_ps(hi, _mm_max_ps(lo, _mm_loadu_ps(src + i))), scale);
+            _mm_storeu_si128((__m128i*)(dst + i), _mm_cvtps_epi32(a));
+        }
+        f32_to_s32_scalar(src + i, n - i, (uint8_t*)(dst + i));
+    }
+
+    void f32_to_s8_sse2(const float* src, size_t n, uint8_t* out)
+    {
+        auto dst = (int8_t*)out;
+        const __m128 scale = _mm_set1_ps(127.0f);
+        const __m128 lo = _mm_set1_ps(-1.0f);
+        const __m128 hi = _mm_set1_ps(1.0f);
+
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m128i w0, w1;
+            {
+                __m128 a = _mm_mul_ps(_mm_min_ps(hi, _mm_max_ps(lo, _mm_loadu_ps(src + i))), scale);
+                __m128 b = _mm_mul_ps(_mm_min_ps(hi, _mm_max_ps(lo, _mm_loadu_ps(src + i + 4))), scale);
+                w0 = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+            }
+            {
+                __m128 a = _mm_mul_ps(_mm_min_ps(hi, _mm_max_ps(lo, _mm_loadu_ps(src + i + 8))), scale);
+                __m128 b = _mm_mul_ps(_mm_min_ps(hi, _mm_max_ps(lo, _mm_loadu_ps(src + i + 12))), scale);
+                w1 = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+            }
+            _mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi16(w0, w1));
+        }
+        f32_to_s8_scalar(src + i, n - i, (uint8_t*)(dst + i));
+    }
+
+#if defined(__GNUC__) || defined(__clang__)
+
+    // --- AVX2 kernels, selected at runtime ----------------------------------
+
+    __attribute__((target("avx2")))
+    void f32_to_s16_avx2(const float* src, size_t n, uint8_t* out)
+    {
+        auto dst = (int16_t*)out;
+        const __m256 scale = _mm256_set1_ps(32767.0f);
+        const __m256 lo = _mm256_set1_ps(-1.0f);
+        const __m256 hi = _mm256_set1_ps(1.0f);
+
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m256 a = _mm256_mul_ps(_mm256_min_ps(hi, _mm256_max_ps(lo, _mm256_loadu_ps(src + i))), scale);
+            __m256 b = _mm256_mul_ps(_mm256_min_ps(hi, _mm256_max_ps(lo, _mm256_loadu_ps(src + i + 8))), scale);
+            __m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+            // packs works per 128-bit lane, restore sample order
+            packed = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+            _mm256_storeu_si256((__m256i*)(dst + i), packed);
+        }
+        f32_to_s16_scalar(src + i, n - i, (uint8_t*)(dst + i));
+    }
+
+    __attribute__((target("avx2")))
+    void f32_to_s32_avx2(const float* src, size_t n, uint8_t* out)
+    {
+        auto dst = (int32_t*)out;
+        const __m256 scale = _mm256_set1_ps(2147483520.0f);
+        const __m256 lo = _mm256_set1_ps(-1.0f);
+        const __m256 hi = _mm256_set1_ps(1.0f);
+
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256 a = _mm256_mul_ps(_mm256_min_ps(hi, _mm256_max_ps(lo, _mm256_loadu_ps(src + i))), scale);
+            _mm256_storeu_si256((__m256i*)(dst + i), _mm256_cvtps_epi32(a));
+        }
+        f32_to_s32_scalar(src + i, n - i, (uint8_t*)(dst + i));
+    }
+
+#endif // __GNUC__ || __clang__
+#endif // AS_CONVERT_X86
+
+#ifdef AS_CONVERT_NEON
+
+    void f32_to_s16_neon(const float* src, size_t n, uint8_t* out)
+    {
+        auto dst = (int16_t*)out;
+        const float32x4_t scale = vdupq_n_f32(32767.0f);
+        const float32x4_t lo = vdupq_n_f32(-1.0f);
+        const float32x4_t hi = vdupq_n_f32(1.0f);
+
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            float32x4_t a = vmulq_f32(vminq_f32(hi, vmaxq_f32(lo, vld1q_f32(src + i))), scale);
+            float32x4_t b = vmulq_f32(vminq_f32(hi, vmaxq_f32(lo, vld1q_f32(src + i + 4))), scale);
+            int16x8_t packed = vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(a)), vqmovn_s32(vcvtnq_s32_f32(b)));
+            vst1q_s16(dst + i, packed);
+        }
+        f32_to_s16_scalar(src + i, n - i, (uint8_t*)(dst + i));
+    }
+
+#endif // AS_CONVERT_NEON
+
+    using kernel_t = void (*)(const float*, size_t, uint8_t*);
+
+    struct kernel_table {
+        kernel_t s8 = f32_to_s8_scalar;
+        kernel_t s16 = f32_to_s16_scalar;
+        kernel_t s24 = f32_to_s24_scalar;
+        kernel_t s32 = f32_to_s32_scalar;
+        const char* name = "scalar";
+    };
+
+    kernel_table select_kernels()
+    {
+        kernel_table table;
+#ifdef AS_CONVERT_X86
+        table.s8 = f32_to_s8_sse2;
+        table.s16 = f32_to_s16_sse2;
+        table.s32 = f32_to_s32_sse2;
+        table.name = "sse2";
+#if defined(__GNUC__) || defined(__clang__)
+        if (__builtin_cpu_supports("avx2")) {
+            table.s16 = f32_to_s16_avx2;
+            table.s32 = f32_to_s32_avx2;
+            table.name = "avx2";
+        }
+#endif
+#endif
+#ifdef AS_CONVERT_NEON
+        table.s16 = f32_to_s16_neon;
+        table.name = "neon";
+#endif
+        return table;
+    }
+
+    const kernel_table& kernels()
+    {
+        static const kernel_table table = select_kernels();
+        return table;
+    }
+
+} // namespace
+
+void sample_converter::convert_f32(const float* src, size_t samples, pcm_encoding encoding, uint8_t* out)
+{
+    switch (encoding) {
+    case pcm_encoding::s8:
+        kernels().s8(src, samples, out);
+        break;
+    case pcm_encoding::s16:
+        kernels().s16(src, samples, out);
+        break;
+    case pcm_encoding::s24:
+        kernels().s24(src, samples, out);
+        break;
+    case pcm_encoding::s32:
+        kernels().s32(src, samples, out);
+        break;
+    }
+}
+
+const char* sample_converter::dispatch_name()
+{
+    return kernels().name;
+}
+
+} // namespace audio_share
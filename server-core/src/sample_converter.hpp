@@ -0,0 +1,74 @@
+/*
+   Copyright 2022-2024 mkckr0 <https://github.com/mkckr0>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef SAMPLE_CONVERTER_HPP
+#define SAMPLE_CONVERTER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace audio_share {
+
+/**
+ * @brief Vectorized PCM sample-format conversion.
+ *
+ * Converts an interleaved f32 capture quantum to a client's negotiated
+ * integer encoding. Kernels are dispatched once at startup: AVX2 where the
+ * compiler and CPU support it, SSE2 on x86-64, NEON on AArch64, with scalar
+ * fallbacks everywhere else. The broadcast path converts once per distinct
+ * target encoding per quantum, never per client.
+ */
+class sample_converter {
+public:
+    enum class pcm_encoding {
+        s8,
+        s16,
+        s24,
+        s32,
+    };
+
+    static size_t bytes_per_sample(pcm_encoding encoding)
+    {
+        switch (encoding) {
+        case pcm_encoding::s8:
+            return 1;
+        case pcm_encoding::s16:
+            return 2;
+        case pcm_encoding::s24:
+            return 3;
+        case pcm_encoding::s32:
+            return 4;
+        }
+        return 0;
+    }
+
+    /**
+     * @brief Convert @p samples interleaved f32 samples to @p encoding
+     * @param src f32 samples in [-1, 1] (values outside are clamped)
+     * @param samples Number of samples (all channels together)
+     * @param out Destination, at least samples * bytes_per_sample(encoding) bytes
+     */
+    static void convert_f32(const float* src, size_t samples, pcm_encoding encoding, uint8_t* out);
+
+    /**
+     * @brief Name of the kernel set selected at startup ("avx2", "sse2", "neon", "scalar")
+     */
+    static const char* dispatch_name();
+};
+
+} // namespace audio_share
+
+#endif // !SAMPLE_CONVERTER_HPP
@@ -0,0 +1,143 @@
+/*
+   Copyright 2022-2024 mkckr0 <https://github.com/mkckr0>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "sample_mixer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || (defined(_M_X64) && !defined(_M_ARM64EC))
+#include <emmintrin.h>
+#define AUDIO_SHARE_MIX_SSE2 1
+#endif
+#if defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define AUDIO_SHARE_MIX_NEON 1
+#endif
+
+namespace audio_share {
+
+namespace {
+
+    void mix_f32(float* dst, const float* src, size_t samples)
+    {
+#if defined(AUDIO_SHARE_MIX_SSE2)
+        size_t i = 0;
+        for (; i + 4 <= samples; i += 4) {
+            _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_loadu_ps(src + i)));
+        }
+        for (; i < samples; ++i) {
+            dst[i] += src[i];
+        }
+#elif defined(AUDIO_SHARE_MIX_NEON)
+        size_t i = 0;
+        for (; i + 4 <= samples; i += 4) {
+            vst1q_f32(dst + i, vaddq_f32(vld1q_f32(dst + i), vld1q_f32(src + i)));
+        }
+        for (; i < samples; ++i) {
+            dst[i] += src[i];
+        }
+#else
+        for (size_t i = 0; i < samples; ++i) {
+            dst[i] += src[i];
+        }
+#endif
+    }
+
+    void mix_s16(int16_t* dst, const int16_t* src, size_t samples)
+    {
+#if defined(AUDIO_SHARE_MIX_SSE2)
+        size_t i = 0;
+        for (; i + 8 <= samples; i += 8) {
+            auto a = _mm_loadu_si128((const __m128i*)(dst + i));
+            auto b = _mm_loadu_si128((const __m128i*)(src + i));
+            _mm_storeu_si128((__m128i*)(dst + i), _mm_adds_epi16(a, b));
+        }
+        for (; i < samples; ++i) {
+            dst[i] = (int16_t)std::clamp((int32_t)dst[i] + src[i], -32768, 32767);
+        }
+#elif defined(AUDIO_SHARE_MIX_NEON)
+        size_t i = 0;
+        for (; i + 8 <= samples; i += 8) {
+            vst1q_s16(dst + i, vqaddq_s16(vld1q_s16(dst + i), vld1q_s16(src + i)));
+        }
+        for (; i < samples; ++i) {
+            dst[i] = (int16_t)std::clamp((int32_t)dst[i] + src[i], -32768, 32767);
+        }
+#else
+        for (size_t i = 0; i < samples; ++i) {
+            dst[i] = (int16_t)std::clamp((int32_t)dst[i] + src[i], -32768, 32767);
+        }
+#endif
+    }
+
+    void mix_u8(uint8_t* dst, const uint8_t* src, size_t samples)
+    {
+        // 8-bit PCM is unsigned with a 128 bias; remove one bias before the
+        // saturating sum so silence mixes to silence
+        for (size_t i = 0; i < samples; ++i) {
+            dst[i] = (uint8_t)std::clamp((int)dst[i] + src[i] - 128, 0, 255);
+        }
+    }
+
+    void mix_s32(int32_t* dst, const int32_t* src, size_t samples)
+    {
+        for (size_t i = 0; i < samples; ++i) {
+            int64_t sum = (int64_t)dst[i] + src[i];
+            dst[i] = (int32_t)std::clamp<int64_t>(sum, INT32_MIN, INT32_MAX);
+        }
+    }
+
+    void mix_s24(uint8_t* dst, const uint8_t* src, size_t samples)
+    {
+        // Packed little-endian 3-byte samples; no lane type matches, so
+        // widen, saturate, repack per sample
+        for (size_t i = 0; i < samples; ++i) {
+            uint8_t* d = dst + i * 3;
+            const uint8_t* s = src + i * 3;
+            int32_t a = (int32_t)(((uint32_t)d[0] << 8 | (uint32_t)d[1] << 16 | (uint32_t)d[2] << 24)) >> 8;
+            int32_t b = (int32_t)(((uint32_t)s[0] << 8 | (uint32_t)s[1] << 16 | (uint32_t)s[2] << 24)) >> 8;
+            int32_t sum = std::clamp(a + b, -(1 << 23), (1 << 23) - 1);
+            d[0] = (uint8_t)(sum & 0xff);
+            d[1] = (uint8_t)((sum >> 8) & 0xff);
+            d[2] = (uint8_t)((sum >> 16) & 0xff);
+        }
+    }
+
+} // namespace
+
+void sample_mixer::mix_into(uint8_t* dst, const uint8_t* src, size_t bytes, mix_encoding encoding)
+{
+    switch (encoding) {
+    case mix_encoding::f32:
+        mix_f32((float*)dst, (const float*)src, bytes / 4);
+        break;
+    case mix_encoding::u8:
+        mix_u8(dst, src, bytes);
+        break;
+    case mix_encoding::s16:
+        mix_s16((int16_t*)dst, (const int16_t*)src, bytes / 2);
+        break;
+    case mix_encoding::s24:
+        mix_s24(dst, src, bytes / 3);
+        break;
+    case mix_encoding::s32:
+        mix_s32((int32_t*)dst, (const int32_t*)src, bytes / 4);
+        break;
+    }
+}
+
+} // namespace audio_share
@@ -0,0 +1,59 @@
+/*
+   Copyright 2022-2024 mkckr0 <https://github.com/mkckr0>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef SAMPLE_MIXER_HPP
+#define SAMPLE_MIXER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace audio_share {
+
+/**
+ * @brief Vectorized in-place mixing of one capture stream into another.
+ *
+ * Combines aligned quanta from secondary capture sources (e.g. a
+ * microphone) into the primary endpoint's quantum before it enters the
+ * broadcast path. Integer formats use saturating adds so a hot mix clips
+ * instead of wrapping; f32 is a plain fused sum, leaving headroom handling
+ * to the client like the rest of the float path. Kernels use SSE2 / NEON
+ * where the target has them and autovectorizable scalar loops elsewhere.
+ * The mix runs once per quantum on the capture thread, never per client.
+ */
+class sample_mixer {
+public:
+    // Wire sample layout of the capture quantum; u8 is the unsigned 8-bit
+    // PCM both backends deliver for the "s8" encoding
+    enum class mix_encoding {
+        f32,
+        u8,
+        s16,
+        s24,
+        s32,
+    };
+
+    /**
+     * @brief Mix @p bytes bytes of @p src into @p dst in place
+     * @param dst The primary quantum, updated in place
+     * @param src A secondary source's bytes, same format and channel order
+     * @param bytes Byte count; anything past a whole sample is ignored
+     */
+    static void mix_into(uint8_t* dst, const uint8_t* src, size_t bytes, mix_encoding encoding);
+};
+
+} // namespace audio_share
+
+#endif // !SAMPLE_MIXER_HPP
@@ -0,0 +1,103 @@
+/*
+   Copyright 2022-2024 mkckr0 <https://github.com/mkckr0>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "sample_rate_converter.hpp"
+
+#include <cmath>
+#include <cstring>
+
+namespace audio_share {
+
+sample_rate_converter::sample_rate_converter(int in_rate, int out_rate, int channels)
+    : _out_rate(out_rate)
+    , _channels(channels)
+    , _step_q32(((uint64_t)in_rate << 32) / (uint64_t)out_rate)
+    , _pos_q32((uint64_t)(TAPS - 1) << 32)
+{
+    // Kaiser-free design: windowed sinc with a Hann window is plenty for a
+    // 16-tap kernel. When downsampling, the cutoff scales with the ratio so
+    // aliasing folds below the stopband instead of into the audio band.
+    const double ratio = (double)out_rate / (double)in_rate;
+    const double cutoff = 0.9 * (ratio < 1.0 ? ratio : 1.0);
+    const double pi = 3.14159265358979323846;
+
+    _table.resize((size_t)PHASES * TAPS);
+    for (int p = 0; p < PHASES; ++p) {
+        const double frac = (double)p / PHASES;
+        double sum = 0.0;
+        for (int t = 0; t < TAPS; ++t) {
+            // Tap t weighs the input frame (TAPS - 1 - t) frames behind the
+            // read head, offset by the phase fraction
+            const double x = (double)t - (double)(TAPS / 2 - 1) - frac;
+            const double arg = pi * cutoff * x;
+            const double sinc = x == 0.0 ? 1.0 : std::sin(arg) / arg;
+            const double window = 0.5 * (1.0 + std::cos(pi * x / (TAPS / 2)));
+            const double h = cutoff * sinc * (window > 0.0 ? window : 0.0);
+            _table[(size_t)p * TAPS + t] = (float)h;
+            sum += h;
+        }
+        // Normalize each phase to unit DC gain so level is ratio-independent
+        for (int t = 0; t < TAPS; ++t) {
+            _table[(size_t)p * TAPS + t] = (float)(_table[(size_t)p * TAPS + t] / sum);
+        }
+    }
+
+    _work.assign((size_t)TAPS * channels, 0.0f);
+}
+
+size_t sample_rate_converter::process(const float* in, size_t frames, std::vector<uint8_t>& out)
+{
+    if (frames == 0) {
+        out.clear();
+        return 0;
+    }
+
+    // Work buffer: TAPS frames of history followed by the new quantum
+    _work.resize((TAPS + frames) * _channels);
+    std::memcpy(_work.data() + (size_t)TAPS * _channels, in, frames * _channels * sizeof(float));
+
+    // Upper bound on the output for this quantum
+    const size_t max_out_frames = (size_t)((((uint64_t)frames << 32) / _step_q32) + 2);
+    out.resize(max_out_frames * _channels * sizeof(float));
+    float* op = (float*)out.data();
+
+    size_t out_frames = 0;
+    const uint64_t end_q32 = (uint64_t)(frames + TAPS - 1) << 32;
+    while (_pos_q32 <= end_q32) {
+        const size_t i = (size_t)(_pos_q32 >> 32);
+        const size_t phase = ((uint64_t)(uint32_t)_pos_q32 * PHASES) >> 32;
+        const float* taps = &_table[phase * TAPS];
+        const float* base = &_work[(i - (TAPS - 1)) * _channels];
+        for (int c = 0; c < _channels; ++c) {
+            float acc = 0.0f;
+            for (int t = 0; t < TAPS; ++t) {
+                acc += taps[t] * base[(size_t)t * _channels + c];
+            }
+            *op++ = acc;
+        }
+        ++out_frames;
+        _pos_q32 += _step_q32;
+    }
+
+    // Keep the last TAPS frames as history and rebase the read position
+    std::memmove(_work.data(), _work.data() + frames * _channels, (size_t)TAPS * _channels * sizeof(float));
+    _pos_q32 -= (uint64_t)frames << 32;
+
+    out.resize(out_frames * _channels * sizeof(float));
+    return out.size();
+}
+
+} // namespace audio_share
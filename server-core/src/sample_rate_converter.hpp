@@ -0,0 +1,75 @@
+/*
+   Copyright 2022-2024 mkckr0 <https://github.com/mkckr0>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef SAMPLE_RATE_CONVERTER_HPP
+#define SAMPLE_RATE_CONVERTER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace audio_share {
+
+/**
+ * @brief Streaming polyphase sample-rate converter.
+ *
+ * Windowed-sinc FIR with 32 phases of 16 taps, precomputed per rate pair at
+ * construction. The read position advances in Q32 fixed point, so arbitrary
+ * ratios (44.1 <-> 48 kHz included) stay drift-free; the last taps of each
+ * quantum are carried as history, making output continuous across quanta.
+ * The tap loop is a plain strided dot product that the compiler vectorizes.
+ *
+ * One converter serves every client that negotiated the same output rate:
+ * the broadcast path resamples once per distinct rate per quantum, never
+ * per client. Input and output are interleaved f32; encoding conversion
+ * happens downstream in sample_converter.
+ */
+class sample_rate_converter {
+public:
+    /**
+     * @brief Build the polyphase bank for one rate pair
+     * @param in_rate Capture sample rate (Hz)
+     * @param out_rate Negotiated client rate (Hz)
+     * @param channels Interleaved channel count
+     */
+    sample_rate_converter(int in_rate, int out_rate, int channels);
+
+    int out_rate() const { return _out_rate; }
+
+    /**
+     * @brief Resample one quantum of interleaved f32 frames
+     * @param in Interleaved f32 input
+     * @param frames Input frame count (samples per channel)
+     * @param out Receives the interleaved f32 output, replacing its contents
+     * @return Bytes written to @p out
+     */
+    size_t process(const float* in, size_t frames, std::vector<uint8_t>& out);
+
+private:
+    static constexpr int PHASES = 32;
+    static constexpr int TAPS = 16;
+
+    int _out_rate;
+    int _channels;
+    uint64_t _step_q32;  // in_rate / out_rate in Q32
+    uint64_t _pos_q32;   // read position into _work, frame units in Q32
+    std::vector<float> _table;  // PHASES rows of TAPS coefficients
+    std::vector<float> _work;   // TAPS history frames + current quantum
+};
+
+} // namespace audio_share
+
+#endif // !SAMPLE_RATE_CONVERTER_HPP
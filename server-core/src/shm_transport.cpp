@@ -0,0 +1,189 @@
+/*
+   Copyright 2022-2024 mkckr0 <https://github.com/mkckr0>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "shm_transport.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include <spdlog/spdlog.h>
+
+#ifdef linux
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WINDOWS
+#include <Windows.h>
+#include "win32/audio_manager_impl.hpp"  // str_win_err
+#endif
+
+namespace audio_share {
+
+shm_transport::shm_transport(size_t capacity)
+    : _capacity(capacity)
+{
+    const size_t total = sizeof(shm_header) + capacity;
+
+#ifdef linux
+    _name = "/audio-share-" + std::to_string(getpid());
+    // O_EXCL so a stale region from a crashed instance is never reused with
+    // old cursors; unlink and retry once instead
+    int fd = shm_open(_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0 && errno == EEXIST) {
+        shm_unlink(_name.c_str());
+        fd = shm_open(_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    }
+    if (fd < 0) {
+        spdlog::info("shm unavailable ({}), same-host peers stay on UDP", strerror(errno));
+        return;
+    }
+    if (ftruncate(fd, (off_t)total) != 0) {
+        spdlog::info("shm ftruncate failed ({}), same-host peers stay on UDP", strerror(errno));
+        close(fd);
+        shm_unlink(_name.c_str());
+        return;
+    }
+    void* base = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        spdlog::info("shm mmap failed ({}), same-host peers stay on UDP", strerror(errno));
+        close(fd);
+        shm_unlink(_name.c_str());
+        return;
+    }
+    _fd = fd;
+    _header = (shm_header*)base;
+#endif
+
+#ifdef _WINDOWS
+    _name = "Local\\audio-share-" + std::to_string(GetCurrentProcessId());
+    HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+        (DWORD)((uint64_t)total >> 32), (DWORD)(total & 0xffffffffu), _name.c_str());
+    if (!mapping) {
+        spdlog::info("shm unavailable ({}), same-host peers stay on UDP", str_win_err((int)GetLastError()));
+        return;
+    }
+    void* base = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, total);
+    if (!base) {
+        spdlog::info("shm map view failed ({}), same-host peers stay on UDP", str_win_err((int)GetLastError()));
+        CloseHandle(mapping);
+        return;
+    }
+    HANDLE event = CreateEventA(nullptr, TRUE, FALSE, (_name + "-event").c_str());
+    if (!event) {
+        spdlog::info("shm event failed ({}), same-host peers stay on UDP", str_win_err((int)GetLastError()));
+        UnmapViewOfFile(base);
+        CloseHandle(mapping);
+        return;
+    }
+    _mapping = mapping;
+    _event = event;
+    _header = (shm_header*)base;
+#endif
+
+    if (!_header) {
+        return;
+    }
+
+    _ring = (char*)_header + sizeof(shm_header);
+    _header->capacity = capacity;
+    _header->write_pos.store(0, std::memory_order_relaxed);
+    _header->seq.store(0, std::memory_order_relaxed);
+    _header->version = VERSION;
+    // Magic last, so a concurrent open never sees a half-initialized header
+    std::atomic_thread_fence(std::memory_order_release);
+    _header->magic = MAGIC;
+    spdlog::info("shm transport ready: {} ({} KiB)", _name, capacity / 1024);
+}
+
+shm_transport::~shm_transport()
+{
+#ifdef linux
+    if (_header) {
+        munmap(_header, sizeof(shm_header) + _capacity);
+    }
+    if (_fd >= 0) {
+        close(_fd);
+        shm_unlink(_name.c_str());
+    }
+#endif
+#ifdef _WINDOWS
+    if (_header) {
+        UnmapViewOfFile(_header);
+    }
+    if (_event) {
+        CloseHandle((HANDLE)_event);
+    }
+    if (_mapping) {
+        CloseHandle((HANDLE)_mapping);
+    }
+#endif
+}
+
+void shm_transport::write_quantum(const char* data, uint32_t size, int32_t block_align, uint64_t capture_us)
+{
+    if (!_header || size == 0) {
+        return;
+    }
+    const size_t record = sizeof(size) + sizeof(block_align) + sizeof(capture_us) + size;
+    if (record > _capacity) {
+        // A record a reader could never hold would corrupt every cursor
+        return;
+    }
+
+    uint64_t pos = _header->write_pos.load(std::memory_order_relaxed);
+    write_bytes(pos, &size, sizeof(size));
+    pos += sizeof(size);
+    write_bytes(pos, &block_align, sizeof(block_align));
+    pos += sizeof(block_align);
+    write_bytes(pos, &capture_us, sizeof(capture_us));
+    pos += sizeof(capture_us);
+    write_bytes(pos, data, size);
+    pos += size;
+
+    // Publish the payload before the cursor so readers never see a record
+    // ahead of its bytes
+    _header->write_pos.store(pos, std::memory_order_release);
+    _header->seq.fetch_add(1, std::memory_order_release);
+    wake_consumers();
+}
+
+void shm_transport::write_bytes(uint64_t pos, const void* src, size_t n)
+{
+    const size_t off = (size_t)(pos & (_capacity - 1));
+    const size_t first = std::min(n, _capacity - off);
+    std::memcpy(_ring + off, src, first);
+    std::memcpy(_ring, (const char*)src + first, n - first);
+}
+
+void shm_transport::wake_consumers()
+{
+#ifdef linux
+    // Plain (shared) futex wake on the seq word; consumers of other
+    // processes wait on the same mapping
+    syscall(SYS_futex, &_header->seq, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+#ifdef _WINDOWS
+    // Manual-reset event pulsing per record; consumers reset after reading
+    // and re-check seq to close the race
+    SetEvent((HANDLE)_event);
+#endif
+}
+
+} // namespace audio_share
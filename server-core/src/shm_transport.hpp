@@ -0,0 +1,103 @@
+/*
+   Copyright 2022-2024 mkckr0 <https://github.com/mkckr0>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef SHM_TRANSPORT_HPP
+#define SHM_TRANSPORT_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace audio_share {
+
+/**
+ * @brief Shared-memory broadcast ring for same-host clients.
+ *
+ * The mapping starts with an shm_header followed by a power-of-2 byte ring.
+ * Each quantum is one record [size:u32][block_align:i32][capture_us:u64]
+ * [payload] written at write_pos modulo the capacity, wrapping bytewise.
+ * write_pos is monotonic; every reader keeps its own cursor and has been
+ * lapped when write_pos - cursor exceeds the capacity, in which case it
+ * resynchronizes to write_pos and resumes from the live edge. seq increments
+ * once per record and doubles as the wake word: consumers futex-wait on it
+ * on Linux and wait on the named manual-reset event "<name>-event" on
+ * Windows (always pairing the wakeup with a seq comparison).
+ *
+ * The region is created on demand when the first localhost peer negotiates
+ * CMD_FLAG_SHM; its name travels back in the cmd_start_play reply. Only the
+ * broadcast strand writes, so the producer side needs no locking.
+ */
+class shm_transport {
+public:
+    struct shm_header {
+        uint32_t magic;     // MAGIC, so a stale name is never misread
+        uint32_t version;   // bump on any layout change
+        uint64_t capacity;  // ring bytes following this header, power of 2
+        std::atomic<uint64_t> write_pos;  // monotonic byte cursor
+        std::atomic<uint32_t> seq;        // record counter and wake word
+        uint32_t _pad;
+    };
+
+    static constexpr uint32_t MAGIC = 0x4d485341u;  // "ASHM" read as LE u32
+    static constexpr uint32_t VERSION = 1;
+
+    /**
+     * @brief Create the region and wake primitive
+     * @param capacity Ring capacity in bytes, must be a power of 2
+     */
+    explicit shm_transport(size_t capacity);
+    ~shm_transport();
+
+    shm_transport(const shm_transport&) = delete;
+    shm_transport& operator=(const shm_transport&) = delete;
+
+    /**
+     * @brief Whether the region was set up successfully
+     */
+    bool valid() const { return _header != nullptr; }
+
+    /**
+     * @brief Name clients pass to shm_open / OpenFileMapping
+     */
+    const std::string& name() const { return _name; }
+
+    /**
+     * @brief Append one quantum record and wake the consumers.
+     *        Called only from the broadcast strand.
+     */
+    void write_quantum(const char* data, uint32_t size, int32_t block_align, uint64_t capture_us);
+
+private:
+    void write_bytes(uint64_t pos, const void* src, size_t n);
+    void wake_consumers();
+
+    std::string _name;
+    shm_header* _header = nullptr;
+    char* _ring = nullptr;
+    size_t _capacity = 0;
+#ifdef linux
+    int _fd = -1;
+#endif
+#ifdef _WINDOWS
+    void* _mapping = nullptr;
+    void* _event = nullptr;
+#endif
+};
+
+} // namespace audio_share
+
+#endif // !SHM_TRANSPORT_HPP
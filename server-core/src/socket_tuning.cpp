@@ -0,0 +1,207 @@
+/*
+   Copyright 2022-2024 mkckr0 <https://github.com/mkckr0>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "socket_tuning.hpp"
+
+#include <cstring>
+
+#include <spdlog/spdlog.h>
+
+#ifdef linux
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <sys/socket.h>
+#endif
+
+#ifdef _WINDOWS
+#include <WinSock2.h>
+#include <qos2.h>
+#include "win32/audio_manager_impl.hpp"  // str_win_err
+#endif
+
+namespace audio_share {
+
+namespace {
+
+#ifdef linux
+    // TOS byte carries the DSCP in its upper six bits
+    int set_dscp(int fd, int dscp)
+    {
+        int tos = dscp << 2;
+        // The server socket is dual-stack: TCLASS covers the v6 half, TOS the
+        // v4-mapped half. A v4-only TCP peer rejects TCLASS, which is fine.
+        int rc = setsockopt(fd, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
+        setsockopt(fd, IPPROTO_IPV6, IPV6_TCLASS, &tos, sizeof(tos));
+        return rc;
+    }
+#endif
+
+} // namespace
+
+socket_tuner::socket_tuner(const config_t& config)
+    : _config(config)
+{
+#ifdef _WINDOWS
+    if (_config.dscp >= 0) {
+        QOS_VERSION version { 1, 0 };
+        HANDLE qos = nullptr;
+        if (QOSCreateHandle(&version, &qos)) {
+            _qos = qos;
+        } else {
+            spdlog::info("qwave unavailable ({}), QoS marking disabled", str_win_err((int)GetLastError()));
+        }
+    }
+#endif
+}
+
+socket_tuner::~socket_tuner()
+{
+#ifdef _WINDOWS
+    if (_qos) {
+        // Closing the handle releases every remaining flow
+        QOSCloseHandle((HANDLE)_qos);
+    }
+#endif
+}
+
+void socket_tuner::tune_udp_server(uintptr_t socket)
+{
+#ifdef linux
+    int fd = (int)socket;
+    if (_config.sndbuf > 0) {
+        if (setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &_config.sndbuf, sizeof(_config.sndbuf)) != 0) {
+            spdlog::warn("{} SO_SNDBUF failed: {}", __func__, strerror(errno));
+        }
+        // The kernel doubles and clamps the request; log what it granted
+        int effective = 0;
+        socklen_t len = sizeof(effective);
+        if (getsockopt(fd, SOL_SOCKET, SO_SNDBUF, &effective, &len) == 0) {
+            spdlog::info("udp socket tuning: SO_SNDBUF {} (requested {})", effective, _config.sndbuf);
+        }
+    }
+    if (_config.dscp >= 0) {
+        if (set_dscp(fd, _config.dscp) == 0) {
+            spdlog::info("udp socket tuning: DSCP {}", _config.dscp);
+        } else {
+            spdlog::warn("{} DSCP marking failed: {}", __func__, strerror(errno));
+        }
+    }
+    if (_config.busy_poll_us > 0) {
+#ifdef SO_BUSY_POLL
+        if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &_config.busy_poll_us, sizeof(_config.busy_poll_us)) == 0) {
+            spdlog::info("udp socket tuning: SO_BUSY_POLL {}us", _config.busy_poll_us);
+        } else {
+            // Needs CAP_NET_ADMIN on most kernels
+            spdlog::warn("{} SO_BUSY_POLL failed: {}", __func__, strerror(errno));
+        }
+#else
+        spdlog::warn("{} SO_BUSY_POLL not supported by this build", __func__);
+#endif
+    }
+#endif
+
+#ifdef _WINDOWS
+    SOCKET s = (SOCKET)socket;
+    if (_config.sndbuf > 0) {
+        if (setsockopt(s, SOL_SOCKET, SO_SNDBUF, (const char*)&_config.sndbuf, sizeof(_config.sndbuf)) != 0) {
+            spdlog::warn("{} SO_SNDBUF failed: {}", __func__, str_win_err(WSAGetLastError()));
+        }
+        int effective = 0;
+        int len = sizeof(effective);
+        if (getsockopt(s, SOL_SOCKET, SO_SNDBUF, (char*)&effective, &len) == 0) {
+            spdlog::info("udp socket tuning: SO_SNDBUF {} (requested {})", effective, _config.sndbuf);
+        }
+    }
+    // The Windows stack ignores IP_TOS; DSCP rides on the qwave flows that
+    // add_udp_flow attaches per registered endpoint
+    if (_config.busy_poll_us > 0) {
+        spdlog::info("busy-poll is Linux-only, ignoring");
+    }
+#endif
+}
+
+void socket_tuner::tune_tcp_peer(uintptr_t socket, const void* dest, size_t dest_len)
+{
+#ifdef linux
+    (void)dest;
+    (void)dest_len;
+    if (_config.dscp >= 0) {
+        if (set_dscp((int)socket, _config.dscp) != 0) {
+            spdlog::debug("{} DSCP marking failed: {}", __func__, strerror(errno));
+        }
+    }
+#endif
+
+#ifdef _WINDOWS
+    (void)dest_len;
+    if (_qos) {
+        // The flow is released automatically when the peer socket closes
+        QOS_FLOWID flow_id = 0;
+        if (!QOSAddSocketToFlow((HANDLE)_qos, (SOCKET)socket, (PSOCKADDR)dest,
+                QOSTrafficTypeVoice, QOS_NON_ADAPTIVE_FLOW, &flow_id)) {
+            spdlog::debug("{} qwave flow failed: {}", __func__, str_win_err((int)GetLastError()));
+            return;
+        }
+        DWORD dscp = (DWORD)_config.dscp;
+        // Arbitrary DSCP values need administrative rights; the Voice
+        // traffic class already got EF-equivalent treatment above
+        if (!QOSSetFlow((HANDLE)_qos, flow_id, QOSSetOutgoingDSCPValue, sizeof(dscp), &dscp, 0, nullptr)) {
+            spdlog::debug("{} qwave DSCP override failed: {}", __func__, str_win_err((int)GetLastError()));
+        }
+    }
+#endif
+}
+
+uint32_t socket_tuner::add_udp_flow(uintptr_t socket, const void* dest, size_t dest_len)
+{
+#ifdef _WINDOWS
+    (void)dest_len;
+    if (!_qos) {
+        return 0;
+    }
+    QOS_FLOWID flow_id = 0;
+    if (!QOSAddSocketToFlow((HANDLE)_qos, (SOCKET)socket, (PSOCKADDR)dest,
+            QOSTrafficTypeVoice, QOS_NON_ADAPTIVE_FLOW, &flow_id)) {
+        spdlog::debug("{} qwave flow failed: {}", __func__, str_win_err((int)GetLastError()));
+        return 0;
+    }
+    DWORD dscp = (DWORD)_config.dscp;
+    if (!QOSSetFlow((HANDLE)_qos, flow_id, QOSSetOutgoingDSCPValue, sizeof(dscp), &dscp, 0, nullptr)) {
+        spdlog::debug("{} qwave DSCP override failed: {}", __func__, str_win_err((int)GetLastError()));
+    }
+    return flow_id;
+#else
+    // Linux marked the whole UDP socket in tune_udp_server
+    (void)socket;
+    (void)dest;
+    (void)dest_len;
+    return 0;
+#endif
+}
+
+void socket_tuner::remove_udp_flow(uintptr_t socket, uint32_t flow_id)
+{
+#ifdef _WINDOWS
+    if (_qos && flow_id != 0) {
+        QOSRemoveSocketFromFlow((HANDLE)_qos, (SOCKET)socket, flow_id, 0);
+    }
+#else
+    (void)socket;
+    (void)flow_id;
+#endif
+}
+
+} // namespace audio_share
@@ -0,0 +1,89 @@
+/*
+   Copyright 2022-2024 mkckr0 <https://github.com/mkckr0>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef SOCKET_TUNING_HPP
+#define SOCKET_TUNING_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace audio_share {
+
+/**
+ * @brief Socket tuning and QoS marking for the audio path.
+ *
+ * On congested networks the audio stream competes with bulk traffic unless
+ * it is marked: the tuner applies SO_SNDBUF, DSCP marking (EF by default,
+ * so QoS-aware switches put audio in the expedited queue) and the optional
+ * Linux SO_BUSY_POLL to the UDP server socket, and marks each accepted TCP
+ * peer the same way since the control socket can carry the fallback stream.
+ *
+ * On Linux the marking is plain IP_TOS/IPV6_TCLASS. On Windows the stack
+ * ignores IP_TOS, so the tuner holds a qwave QoS handle and attaches
+ * per-destination flows instead: one per accepted TCP peer (released with
+ * the socket) and one per registered UDP endpoint, removed when the peer
+ * leaves. Every applied option is logged with its effective value; any
+ * option the host refuses is logged and skipped, never fatal.
+ */
+class socket_tuner {
+public:
+    struct config_t {
+        int sndbuf = 0;        // SO_SNDBUF in bytes, 0 = kernel default
+        int dscp = 46;         // DSCP code point, EF by default; -1 disables marking
+        int busy_poll_us = 0;  // SO_BUSY_POLL in microseconds, Linux only, 0 = off
+    };
+
+    explicit socket_tuner(const config_t& config);
+    ~socket_tuner();
+
+    socket_tuner(const socket_tuner&) = delete;
+    socket_tuner& operator=(const socket_tuner&) = delete;
+
+    /**
+     * @brief Apply send buffer, DSCP marking and busy-poll to the dual-stack
+     *        UDP server socket
+     */
+    void tune_udp_server(uintptr_t socket);
+
+    /**
+     * @brief Mark an accepted TCP peer's socket; on Windows this attaches a
+     *        qwave flow that is released when the socket closes
+     * @param dest The peer's sockaddr, needed for the qwave flow
+     */
+    void tune_tcp_peer(uintptr_t socket, const void* dest, size_t dest_len);
+
+    /**
+     * @brief Attach a qwave flow for one registered UDP endpoint (Windows);
+     *        a no-op elsewhere, where tune_udp_server already marked the socket
+     * @return The flow id to pass to remove_udp_flow, 0 = no flow
+     */
+    uint32_t add_udp_flow(uintptr_t socket, const void* dest, size_t dest_len);
+
+    /**
+     * @brief Detach a flow created by add_udp_flow when the peer leaves
+     */
+    void remove_udp_flow(uintptr_t socket, uint32_t flow_id);
+
+private:
+    config_t _config;
+#ifdef _WINDOWS
+    void* _qos = nullptr;  // HANDLE from QOSCreateHandle, null when qwave is unavailable
+#endif
+};
+
+} // namespace audio_share
+
+#endif // !SOCKET_TUNING_HPP
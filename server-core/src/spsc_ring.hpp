@@ -0,0 +1,145 @@
+/*
+   Copyright 2022-2024 mkckr0 <https://github.com/mkckr0>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef SPSC_RING_HPP
+#define SPSC_RING_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace audio_share {
+
+/**
+ * @brief A wait-free single-producer/single-consumer byte ring for audio quanta.
+ *
+ * The capture callback (producer) runs on a realtime thread and must never
+ * block on a mutex or touch the allocator, so all storage is allocated once
+ * at construction and synchronization is done with two atomic cursors.
+ * Each quantum is framed as [size:u32][block_align:i32][capture_us:u64]
+ * [payload] so the consumer can recover quantum boundaries and measure how
+ * long the quantum sat between capture and send.
+ *
+ * If the ring is full the quantum is dropped and counted; dropping at the
+ * producer is preferable to ever stalling the realtime callback.
+ */
+class spsc_ring {
+public:
+    /**
+     * @brief Construct a ring with the given capacity in bytes (rounded up to a power of two)
+     */
+    explicit spsc_ring(size_t capacity)
+    {
+        size_t n = 1;
+        while (n < capacity) {
+            n <<= 1;
+        }
+        _mask = n - 1;
+        _data.resize(n);
+    }
+
+    /**
+     * @brief Producer side. Write one quantum into the ring.
+     * @return true if the quantum was written, false if the ring was full (quantum dropped)
+     */
+    bool push(const void* data, uint32_t size, int32_t block_align)
+    {
+        const size_t need = sizeof(record_header) + size;
+        const size_t head = _head.load(std::memory_order_relaxed);
+        const size_t tail = _tail.load(std::memory_order_acquire);
+        if (capacity() - (head - tail) < need) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        // Stamp the quantum on the producer so the consumer can measure
+        // capture-to-send latency; steady_clock::now() is a vDSO call and
+        // safe on the realtime thread
+        const uint64_t capture_us = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+
+        record_header header { size, block_align, capture_us };
+        write_bytes(head, &header, sizeof(header));
+        write_bytes(head + sizeof(header), data, size);
+        _head.store(head + need, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Consumer side. Pop one quantum into @p out.
+     * @param capture_us Producer-side steady_clock timestamp in microseconds
+     * @return payload size in bytes, or 0 if the ring is empty
+     */
+    uint32_t pop(std::vector<uint8_t>& out, int32_t& block_align, uint64_t& capture_us)
+    {
+        const size_t tail = _tail.load(std::memory_order_relaxed);
+        const size_t head = _head.load(std::memory_order_acquire);
+        if (head == tail) {
+            return 0;
+        }
+
+        record_header header {};
+        read_bytes(tail, &header, sizeof(header));
+        out.resize(header.size);
+        read_bytes(tail + sizeof(header), out.data(), header.size);
+        block_align = header.block_align;
+        capture_us = header.capture_us;
+        _tail.store(tail + sizeof(header) + header.size, std::memory_order_release);
+        return header.size;
+    }
+
+    size_t capacity() const { return _mask + 1; }
+
+    /**
+     * @brief Number of quanta dropped because the ring was full
+     */
+    uint64_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+private:
+    struct record_header {
+        uint32_t size;
+        int32_t block_align;
+        uint64_t capture_us;
+    };
+
+    void write_bytes(size_t pos, const void* src, size_t n)
+    {
+        const size_t offset = pos & _mask;
+        const size_t first = std::min(n, capacity() - offset);
+        std::memcpy(_data.data() + offset, src, first);
+        std::memcpy(_data.data(), (const uint8_t*)src + first, n - first);
+    }
+
+    void read_bytes(size_t pos, void* dst, size_t n)
+    {
+        const size_t offset = pos & _mask;
+        const size_t first = std::min(n, capacity() - offset);
+        std::memcpy(dst, _data.data() + offset, first);
+        std::memcpy((uint8_t*)dst + first, _data.data(), n - first);
+    }
+
+    std::vector<uint8_t> _data;
+    size_t _mask = 0;
+    alignas(64) std::atomic<size_t> _head { 0 };
+    alignas(64) std::atomic<size_t> _tail { 0 };
+    std::atomic<uint64_t> _dropped { 0 };
+};
+
+} // namespace audio_share
+
+#endif // !SPSC_RING_HPP
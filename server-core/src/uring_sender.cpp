@@ -0,0 +1,146 @@
+/*
+   Copyright 2022-2024 mkckr0 <https://github.com/mkckr0>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifdef AUDIO_SHARE_HAS_URING
+
+#include "uring_sender.hpp"
+#include "metrics.hpp"
+
+#include <cstring>
+
+#include <liburing.h>
+#include <spdlog/spdlog.h>
+
+namespace audio_share {
+
+uring_sender::uring_sender(int sock_fd, unsigned entries)
+    : _sock_fd(sock_fd)
+{
+    auto ring = std::make_unique<io_uring>();
+    int ret = io_uring_queue_init(entries, ring.get(), 0);
+    if (ret < 0) {
+        // Old kernel or seccomp policy without io_uring; the caller keeps
+        // the sendmmsg path
+        spdlog::info("io_uring unavailable ({}), using sendmmsg transmit", strerror(-ret));
+        return;
+    }
+    _ring = std::move(ring);
+    spdlog::info("io_uring transmit enabled, queue depth {}", entries);
+}
+
+uring_sender::~uring_sender()
+{
+    if (!_ring) {
+        return;
+    }
+    // Wait out whatever is still queued so no SQE outlives its batch memory
+    while (!_in_flight.empty()) {
+        io_uring_cqe* cqe = nullptr;
+        if (io_uring_wait_cqe(_ring.get(), &cqe) < 0) {
+            break;
+        }
+        auto* batch = reinterpret_cast<batch_t*>(io_uring_cqe_get_data(cqe));
+        io_uring_cqe_seen(_ring.get(), cqe);
+        if (batch && --batch->remaining == 0) {
+            std::erase_if(_in_flight, [batch](const std::unique_ptr<batch_t>& b) { return b.get() == batch; });
+        }
+    }
+    io_uring_queue_exit(_ring.get());
+}
+
+bool uring_sender::submit(const std::vector<packet_t>& packets, std::shared_ptr<void> keep_alive)
+{
+    if (!_ring || packets.empty()) {
+        return false;
+    }
+
+    reap_completions();
+
+    // The batch owns copies of every iovec and address, so the caller's
+    // stack frames can unwind while the kernel still reads them; the
+    // keep-alive pins the payload bytes themselves.
+    auto batch = std::make_unique<batch_t>();
+    batch->keep_alive = std::move(keep_alive);
+    batch->msgs.resize(packets.size());
+    batch->addrs.resize(packets.size());
+
+    size_t total_iovs = 0;
+    for (const auto& packet : packets) {
+        total_iovs += packet.iov_len;
+    }
+    batch->iovs.reserve(total_iovs);
+
+    for (size_t i = 0; i < packets.size(); ++i) {
+        const auto& packet = packets[i];
+        iovec* iov_base = batch->iovs.data() + batch->iovs.size();
+        batch->iovs.insert(batch->iovs.end(), packet.iov, packet.iov + packet.iov_len);
+        std::memcpy(&batch->addrs[i], packet.addr, packet.addr_len);
+
+        batch->msgs[i] = {};
+        batch->msgs[i].msg_name = &batch->addrs[i];
+        batch->msgs[i].msg_namelen = packet.addr_len;
+        batch->msgs[i].msg_iov = iov_base;
+        batch->msgs[i].msg_iovlen = packet.iov_len;
+    }
+
+    // All SQEs of a batch go in together or not at all, so a full ring
+    // falls back cleanly without partial sends
+    if (io_uring_sq_space_left(_ring.get()) < (unsigned)packets.size()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < packets.size(); ++i) {
+        io_uring_sqe* sqe = io_uring_get_sqe(_ring.get());
+        io_uring_prep_sendmsg(sqe, _sock_fd, &batch->msgs[i], 0);
+        io_uring_sqe_set_data(sqe, batch.get());
+    }
+    batch->remaining = packets.size();
+
+    int ret = io_uring_submit(_ring.get());
+    if (ret < 0) {
+        // The prepped SQEs stay queued in the SQ pointing into this batch,
+        // and the next successful submit flushes them. The batch must stay
+        // alive until their completions arrive, and reporting failure here
+        // would make the caller send the same segments again over
+        // sendmmsg -- so treat the batch as submitted either way.
+        spdlog::trace("io_uring_submit error: {}", strerror(-ret));
+    }
+
+    _in_flight.push_back(std::move(batch));
+    return true;
+}
+
+void uring_sender::reap_completions()
+{
+    io_uring_cqe* cqe = nullptr;
+    while (io_uring_peek_cqe(_ring.get(), &cqe) == 0) {
+        if (cqe->res < 0) {
+            metrics::instance().on_send_error();
+            spdlog::trace("io_uring send error: {}", strerror(-cqe->res));
+        } else {
+            metrics::instance().on_segments_sent(1);
+        }
+        auto* batch = reinterpret_cast<batch_t*>(io_uring_cqe_get_data(cqe));
+        io_uring_cqe_seen(_ring.get(), cqe);
+        if (batch && --batch->remaining == 0) {
+            std::erase_if(_in_flight, [batch](const std::unique_ptr<batch_t>& b) { return b.get() == batch; });
+        }
+    }
+}
+
+} // namespace audio_share
+
+#endif // AUDIO_SHARE_HAS_URING
@@ -0,0 +1,103 @@
+/*
+   Copyright 2022-2024 mkckr0 <https://github.com/mkckr0>
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef URING_SENDER_HPP
+#define URING_SENDER_HPP
+
+#ifdef AUDIO_SHARE_HAS_URING
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <sys/socket.h>
+
+struct io_uring;
+
+namespace audio_share {
+
+/**
+ * @brief io_uring transmit backend for the UDP broadcast socket.
+ *
+ * One quantum's whole fan-out (segments x peers) is queued as sendmsg SQEs
+ * and submitted with a single io_uring_enter, replacing the per-quantum
+ * sendmmsg syscall loop. All calls happen on the broadcast strand, so no
+ * internal locking is needed; completions are reaped non-blocking at the
+ * next submit. Each batch pins the payload slab and header block through a
+ * shared keep-alive until its last completion arrives.
+ *
+ * Created at runtime in start_server; when the kernel lacks io_uring the
+ * constructor leaves the sender invalid and the caller keeps the sendmmsg
+ * path.
+ */
+class uring_sender {
+public:
+    // One datagram: scatter list plus its destination
+    struct packet_t {
+        const iovec* iov;
+        size_t iov_len;
+        const sockaddr* addr;
+        socklen_t addr_len;
+    };
+
+    /**
+     * @brief Set up a ring for the given socket
+     * @param sock_fd The UDP socket's native handle
+     * @param entries Submission queue depth
+     */
+    explicit uring_sender(int sock_fd, unsigned entries = 512);
+    ~uring_sender();
+
+    uring_sender(const uring_sender&) = delete;
+    uring_sender& operator=(const uring_sender&) = delete;
+
+    /**
+     * @brief Whether the ring was set up successfully
+     */
+    bool valid() const { return _ring != nullptr; }
+
+    /**
+     * @brief Queue and submit one quantum's datagrams.
+     * @param packets The datagrams; iovecs and addresses are copied into the batch
+     * @param keep_alive Pins payload memory until the batch completes
+     * @return true if the batch was submitted, false if the ring is full
+     *         (caller should fall back to the sendmmsg path)
+     */
+    bool submit(const std::vector<packet_t>& packets, std::shared_ptr<void> keep_alive);
+
+private:
+    void reap_completions();
+
+    // Owns everything a batch's SQEs point at until the last CQE
+    struct batch_t {
+        std::vector<iovec> iovs;
+        std::vector<msghdr> msgs;
+        std::vector<sockaddr_storage> addrs;
+        std::shared_ptr<void> keep_alive;
+        size_t remaining = 0;
+    };
+
+    int _sock_fd = -1;
+    std::unique_ptr<io_uring> _ring;
+    std::vector<std::unique_ptr<batch_t>> _in_flight;
+};
+
+} // namespace audio_share
+
+#endif // AUDIO_SHARE_HAS_URING
+
+#endif // !URING_SENDER_HPP
@@ -15,6 +15,7 @@
 */
 
 #include "websocket_manager.hpp"
+#include "metrics.hpp"
 
 #include <spdlog/spdlog.h>
 
@@ -28,7 +29,7 @@ websocket_manager::~websocket_manager()
     stop_server();
 }
 
-void websocket_manager::start_server(const std::string& host, uint16_t port, const audio_manager::capture_config& capture_config)
+void websocket_manager::start_server(const std::shared_ptr<asio::io_context>& ioc, const std::string& host, uint16_t port, const audio_manager::capture_config& capture_config)
 {
     if (_is_running) {
         spdlog::warn("[WS] Server already running");
@@ -36,41 +37,40 @@ void websocket_manager::start_server(const std::string& host, uint16_t port, con
     }
 
     _capture_config = capture_config;
-    _ioc = std::make_shared<asio::io_context>();
+    // Share the network manager's io_context: the acceptor and every session
+    // are coroutines on its thread pool, so no second event loop, no extra
+    // thread, and broadcast_audio_data feeds the outboxes on the same loop
+    // that drains them
+    _ioc = ioc;
 
-    _server_thread = std::thread([this, host, port]() {
-        try {
-            // Resolve the host
-            asio::ip::tcp::resolver resolver(*_ioc);
-            auto endpoints = resolver.resolve(host, std::to_string(port));
-            
-            if (endpoints.empty()) {
-                throw std::runtime_error("Failed to resolve host: " + host);
-            }
+    try {
+        // Resolve the host
+        asio::ip::tcp::resolver resolver(*_ioc);
+        auto endpoints = resolver.resolve(host, std::to_string(port));
 
-            // Get endpoint
-            auto endpoint = endpoints.begin()->endpoint();
-            
-            // Create acceptor
-            tcp_acceptor acceptor(*_ioc);
-            acceptor.open(endpoint.protocol());
-            acceptor.set_option(asio::socket_base::reuse_address(true));
-            acceptor.bind(endpoint);
-            acceptor.listen(asio::socket_base::max_listen_connections);
-
-            spdlog::info("[WS] WebSocket server started on {}:{}", host, port);
-            _is_running = true;
-
-            // Run accept loop
-            asio::co_spawn(*_ioc, accept_loop(std::move(acceptor)), asio::detached);
-            _ioc->run();
-        } catch (const std::exception& e) {
-            spdlog::error("[WS] Server error: {}", e.what());
+        if (endpoints.empty()) {
+            throw std::runtime_error("Failed to resolve host: " + host);
         }
 
-        _is_running = false;
-        spdlog::info("[WS] WebSocket server stopped");
-    });
+        // Get endpoint
+        auto endpoint = endpoints.begin()->endpoint();
+
+        _acceptor = std::make_unique<tcp_acceptor>(*_ioc);
+        _acceptor->open(endpoint.protocol());
+        _acceptor->set_option(asio::socket_base::reuse_address(true));
+        _acceptor->bind(endpoint);
+        _acceptor->listen(asio::socket_base::max_listen_connections);
+    } catch (const std::exception& e) {
+        // The WebSocket side is optional; the TCP/UDP server keeps serving
+        spdlog::error("[WS] Server error: {}", e.what());
+        _acceptor = nullptr;
+        _ioc = nullptr;
+        return;
+    }
+
+    _is_running = true;
+    asio::co_spawn(*_ioc, accept_loop(), asio::detached);
+    spdlog::info("[WS] WebSocket server started on {}:{}", host, port);
 }
 
 void websocket_manager::stop_server()
@@ -79,32 +79,33 @@ void websocket_manager::stop_server()
 
     _is_running = false;
 
+    // The io_context belongs to the network manager; only the acceptor and
+    // the sessions are torn down here. The acceptor object stays alive in
+    // case the accept loop still holds a suspended frame over it.
+    if (_acceptor) {
+        std::error_code ec;
+        _acceptor->close(ec);
+    }
+
     // Close all sessions
     {
         std::lock_guard<std::mutex> lock(_sessions_mutex);
         for (auto& [key, session] : _sessions) {
-            if (session && session->ws) {
-                beast::error_code ec;
-                session->ws->close(websocket::close_code::going_away, ec);
+            if (session) {
+                if (session->outbox) {
+                    session->outbox->close();
+                }
+                if (session->ws) {
+                    beast::error_code ec;
+                    session->ws->close(websocket::close_code::going_away, ec);
+                }
             }
         }
         _sessions.clear();
     }
 
-    if (_ioc) {
-        _ioc->stop();
-    }
-
-    if (_server_thread.joinable()) {
-        _server_thread.join();
-    }
-}
-
-void websocket_manager::wait_server()
-{
-    if (_server_thread.joinable()) {
-        _server_thread.join();
-    }
+    _ioc = nullptr;
+    spdlog::info("[WS] WebSocket server stopped");
 }
 
 bool websocket_manager::is_running() const
@@ -112,11 +113,11 @@ bool websocket_manager::is_running() const
     return _is_running;
 }
 
-asio::awaitable<void> websocket_manager::accept_loop(tcp_acceptor acceptor)
+asio::awaitable<void> websocket_manager::accept_loop()
 {
     while (_is_running) {
-        auto [ec, socket] = co_await acceptor.async_accept();
-        
+        auto [ec, socket] = co_await _acceptor->async_accept();
+
         if (ec) {
             if (ec == asio::error::operation_aborted) {
                 break;
@@ -127,9 +128,11 @@ asio::awaitable<void> websocket_manager::accept_loop(tcp_acceptor acceptor)
 
         // Create WebSocket stream
         auto ws = std::make_shared<websocket::stream<beast::tcp_stream>>(std::move(socket));
-        
-        // Spawn session handler
-        asio::co_spawn(*_ioc, handle_session(ws), asio::detached);
+
+        // Each session runs on its own strand: the read, send and heartbeat
+        // coroutines all touch the same stream, and the shared io_context
+        // runs on the network manager's thread pool
+        asio::co_spawn(asio::make_strand(*_ioc), handle_session(ws), asio::detached);
     }
 }
 
@@ -144,26 +147,45 @@ asio::awaitable<void> websocket_manager::handle_session(std::shared_ptr<websocke
             res.set(http::field::server, "AudioShare-WebSocket/1.0");
         }));
 
-        // Read HTTP upgrade request
+        // Read the HTTP request ourselves so a plain GET /stats can be
+        // served from the same port as the WebSocket upgrades
         beast::flat_buffer buffer;
         http::request<http::string_body> req;
-        
+        co_await http::async_read(ws->next_layer(), buffer, req, asio::use_awaitable);
+
+        if (!websocket::is_upgrade(req)) {
+            if (req.method() == http::verb::get && req.target() == "/stats") {
+                http::response<http::string_body> res { http::status::ok, req.version() };
+                res.set(http::field::server, "AudioShare-WebSocket/1.0");
+                res.set(http::field::content_type, "application/json");
+                res.body() = audio_share::metrics::instance().to_json();
+                res.prepare_payload();
+                co_await http::async_write(ws->next_layer(), res, asio::use_awaitable);
+            }
+            beast::error_code shutdown_ec;
+            ws->next_layer().socket().shutdown(asio::ip::tcp::socket::shutdown_send, shutdown_ec);
+            co_return;
+        }
+
         // Accept the WebSocket handshake
-        co_await ws->async_accept(asio::use_awaitable);
-        
+        co_await ws->async_accept(req, asio::use_awaitable);
+
         spdlog::info("[WS] New WebSocket connection");
 
         // Create session
         auto session = std::make_shared<ws_session>();
         session->ws = ws;
+        session->outbox = std::make_unique<frame_channel>(*_ioc, _max_outbox_frames);
         add_session(session);
 
         // Send audio format
         co_await send_audio_format(session);
 
-        // Start heartbeat and send loops
-        asio::co_spawn(*_ioc, heartbeat_loop(session), asio::detached);
-        asio::co_spawn(*_ioc, send_loop(session), asio::detached);
+        // Start heartbeat and send loops on this session's strand so their
+        // stream writes serialize with the read loop below
+        auto session_executor = co_await asio::this_coro::executor;
+        asio::co_spawn(session_executor, heartbeat_loop(session), asio::detached);
+        asio::co_spawn(session_executor, send_loop(session), asio::detached);
 
         // Read loop for receiving client messages
         while (_is_running) {
@@ -199,6 +221,9 @@ asio::awaitable<void> websocket_manager::handle_session(std::shared_ptr<websocke
         std::lock_guard<std::mutex> lock(_sessions_mutex);
         for (auto it = _sessions.begin(); it != _sessions.end(); ++it) {
             if (it->second->ws == ws) {
+                if (it->second->outbox) {
+                    it->second->outbox->close();  // Wake the send loop so it exits
+                }
                 _sessions.erase(it);
                 break;
             }
@@ -246,31 +271,20 @@ asio::awaitable<void> websocket_manager::heartbeat_loop(std::shared_ptr<ws_sessi
 
 asio::awaitable<void> websocket_manager::send_loop(std::shared_ptr<ws_session> session)
 {
-    asio::steady_timer timer(*_ioc);
-    
     while (_is_running && session && session->ws && session->ws->is_open()) {
-        // Check for queued audio data
-        std::vector<uint8_t> audio_data;
-        {
-            std::lock_guard<std::mutex> lock(session->queue_mutex);
-            if (!session->audio_queue.empty()) {
-                audio_data = std::move(session->audio_queue.front());
-                session->audio_queue.pop();
-            }
+        // Block until the broadcast side delivers a frame; no polling timer
+        auto [ec, frame] = co_await session->outbox->async_receive(asio::as_tuple(asio::use_awaitable));
+        if (ec || !frame) {
+            // Channel closed or cancelled, session is going away
+            break;
         }
 
-        if (!audio_data.empty()) {
-            try {
-                session->ws->binary(true);
-                co_await session->ws->async_write(asio::buffer(audio_data));
-            } catch (const std::exception& e) {
-                spdlog::warn("[WS] Send error: {}", e.what());
-                break;
-            }
-        } else {
-            // No data, wait a bit
-            timer.expires_after(std::chrono::milliseconds(5));
-            co_await timer.async_wait(asio::use_awaitable);
+        try {
+            session->ws->binary(true);
+            co_await session->ws->async_write(asio::buffer(*frame));
+        } catch (const std::exception& e) {
+            spdlog::warn("[WS] Send error: {}", e.what());
+            break;
         }
     }
 }
@@ -293,18 +307,24 @@ void websocket_manager::broadcast_audio_data(const char* data, size_t count, [[m
 {
     if (!_is_running || count == 0) return;
 
+    // Materialize the frame once; every session shares the same immutable
+    // bytes and only the shared_ptr is copied per outbox
+    auto frame = std::make_shared<const std::vector<uint8_t>>(
+        reinterpret_cast<const uint8_t*>(data),
+        reinterpret_cast<const uint8_t*>(data) + count);
+
     std::lock_guard<std::mutex> lock(_sessions_mutex);
-    
+
     for (auto& [key, session] : _sessions) {
-        if (session && session->ws && session->ws->is_open()) {
-            std::lock_guard<std::mutex> queue_lock(session->queue_mutex);
-            
-            // Limit queue size to prevent memory buildup
-            if (session->audio_queue.size() < 50) {
-                session->audio_queue.emplace(
-                    reinterpret_cast<const uint8_t*>(data),
-                    reinterpret_cast<const uint8_t*>(data) + count
-                );
+        if (session && session->outbox && session->ws && session->ws->is_open()) {
+            // Non-blocking push that wakes the session's send loop. A full
+            // outbox evicts the oldest frame instead of refusing the new
+            // one, so a stalled client loses stale audio but stays
+            // near-live once it drains again.
+            if (!session->outbox->try_send(asio::error_code {}, frame)) {
+                session->outbox->try_receive([](asio::error_code, shared_frame) {});
+                audio_share::metrics::instance().on_queue_drop();
+                session->outbox->try_send(asio::error_code {}, frame);
             }
         }
     }
@@ -24,11 +24,11 @@
 #include <mutex>
 #include <chrono>
 #include <atomic>
-#include <queue>
 
 #include "pre_asio.hpp"
 #include <asio.hpp>
 #include <asio/use_awaitable.hpp>
+#include <asio/experimental/concurrent_channel.hpp>
 
 #include <boost/beast/core.hpp>
 #include <boost/beast/websocket.hpp>
@@ -54,14 +54,21 @@ class websocket_manager : public audio_broadcaster, public std::enable_shared_fr
     using default_token = asio::as_tuple_t<asio::use_awaitable_t<>>;
     using tcp_acceptor = default_token::as_default_on_t<asio::ip::tcp::acceptor>;
     
+    // One immutable frame per capture quantum, shared by every session's
+    // outbox so the copy happens once regardless of session count.
+    using shared_frame = std::shared_ptr<const std::vector<uint8_t>>;
+
+    // Bounded, thread-safe outbox the broadcast side pushes frames into and
+    // the send coroutine awaits. Event-driven: frames are written the moment
+    // they arrive and idle sessions cost zero wakeups.
+    using frame_channel = asio::experimental::concurrent_channel<void(asio::error_code, shared_frame)>;
+
     // WebSocket session info
     struct ws_session {
         std::shared_ptr<websocket::stream<beast::tcp_stream>> ws;
-        std::queue<std::vector<uint8_t>> audio_queue;
-        std::mutex queue_mutex;
-        std::atomic<bool> is_sending{false};
+        std::unique_ptr<frame_channel> outbox;
         std::atomic<std::chrono::steady_clock::time_point> last_tick{std::chrono::steady_clock::now()};
-        
+
         ws_session() = default;
     };
 
@@ -73,22 +80,20 @@ public:
 
     /**
      * @brief Start WebSocket server on specified host and port
+     * @param ioc The network manager's io_context; the acceptor and all
+     *            sessions run as coroutines on its thread pool, so there is
+     *            no second event loop and no cross-loop hand-off per quantum
      * @param host Host address to bind to
      * @param port Port to listen on (will use a different port than TCP/UDP)
      * @param capture_config Audio capture configuration
      */
-    void start_server(const std::string& host, uint16_t port, const audio_manager::capture_config& capture_config);
-    
+    void start_server(const std::shared_ptr<asio::io_context>& ioc, const std::string& host, uint16_t port, const audio_manager::capture_config& capture_config);
+
     /**
      * @brief Stop WebSocket server
      */
     void stop_server();
-    
-    /**
-     * @brief Wait for server thread to complete
-     */
-    void wait_server();
-    
+
     /**
      * @brief Check if server is running
      */
@@ -103,7 +108,7 @@ public:
     void broadcast_audio_data(const char* data, size_t count, int block_align) override;
 
 private:
-    asio::awaitable<void> accept_loop(tcp_acceptor acceptor);
+    asio::awaitable<void> accept_loop();
     asio::awaitable<void> handle_session(std::shared_ptr<websocket::stream<beast::tcp_stream>> ws);
     asio::awaitable<void> send_audio_format(std::shared_ptr<ws_session> session);
     asio::awaitable<void> heartbeat_loop(std::shared_ptr<ws_session> session);
@@ -115,9 +120,9 @@ private:
     std::string build_format_json() const;
 
 private:
-    std::shared_ptr<asio::io_context> _ioc;
+    std::shared_ptr<asio::io_context> _ioc;  // Shared with the network manager
     std::shared_ptr<audio_manager> _audio_manager;
-    std::thread _server_thread;
+    std::unique_ptr<tcp_acceptor> _acceptor;
     session_map_t _sessions;
     mutable std::mutex _sessions_mutex;
     audio_manager::capture_config _capture_config;
@@ -125,6 +130,7 @@ private:
     
     static constexpr auto _heartbeat_interval = std::chrono::seconds(10);
     static constexpr auto _heartbeat_timeout = std::chrono::seconds(30);
+    static constexpr size_t _max_outbox_frames = 50;  // Frames buffered per session before drops
 };
 
 #endif // !WEBSOCKET_MANAGER_HPP
@@ -18,11 +18,15 @@
 
 #include "audio_manager.hpp"
 #include "client.pb.h"
+#include "metrics.hpp"
 #include "network_manager.hpp"
+#include "sample_mixer.hpp"
 
 #include <spdlog/spdlog.h>
 #include <wil/com.h>
+#include <algorithm>
 #include <iostream>
+#include <memory>
 #include <vector>
 #include <cstdlib>
 
@@ -98,13 +102,102 @@ static std::string get_device_name(IPropertyStore* pProp);
 
 namespace detail {
 
+// Marks the endpoint cache dirty on every device change that can affect
+// enumeration; the next get_endpoint_list/get_default_endpoint pays the
+// roundtrip once, every other call is served from memory
+class endpoint_change_notifier : public IMMNotificationClient {
+public:
+    explicit endpoint_change_notifier(std::atomic<bool>* dirty)
+        : _dirty(dirty)
+    {
+    }
+
+    // IUnknown
+    ULONG STDMETHODCALLTYPE AddRef() override { return InterlockedIncrement(&_ref); }
+    ULONG STDMETHODCALLTYPE Release() override
+    {
+        ULONG ref = InterlockedDecrement(&_ref);
+        if (ref == 0) {
+            delete this;
+        }
+        return ref;
+    }
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppv) override
+    {
+        if (riid == IID_IUnknown || riid == __uuidof(IMMNotificationClient)) {
+            *ppv = static_cast<IMMNotificationClient*>(this);
+            AddRef();
+            return S_OK;
+        }
+        *ppv = nullptr;
+        return E_NOINTERFACE;
+    }
+
+    // IMMNotificationClient
+    HRESULT STDMETHODCALLTYPE OnDeviceStateChanged(LPCWSTR, DWORD) override
+    {
+        _dirty->store(true, std::memory_order_release);
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE OnDeviceAdded(LPCWSTR) override
+    {
+        _dirty->store(true, std::memory_order_release);
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE OnDeviceRemoved(LPCWSTR) override
+    {
+        _dirty->store(true, std::memory_order_release);
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE OnDefaultDeviceChanged(EDataFlow flow, ERole, LPCWSTR) override
+    {
+        if (flow == eRender) {
+            _dirty->store(true, std::memory_order_release);
+        }
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE OnPropertyValueChanged(LPCWSTR, const PROPERTYKEY) override
+    {
+        // Fires constantly (volume, metadata); names rarely change and a
+        // stale name is harmless, so skip the invalidation
+        return S_OK;
+    }
+
+private:
+    std::atomic<bool>* _dirty;
+    LONG _ref = 1;
+};
+
 audio_manager_impl::audio_manager_impl()
 {
     (void)CoInitializeEx(nullptr, COINIT::COINIT_MULTITHREADED);
+
+    HRESULT hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), nullptr, CLSCTX_ALL,
+        __uuidof(IMMDeviceEnumerator), (void**)&_notify_enumerator);
+    if (SUCCEEDED(hr)) {
+        _endpoint_notifier = new endpoint_change_notifier(&_endpoint_cache_dirty);
+        hr = _notify_enumerator->RegisterEndpointNotificationCallback(_endpoint_notifier);
+        if (FAILED(hr)) {
+            // Without notifications the cache can miss a hotplug; log it so
+            // a stale device list is explainable
+            spdlog::warn("RegisterEndpointNotificationCallback failed: {}", str_win_err((int)hr));
+            _endpoint_notifier->Release();
+            _endpoint_notifier = nullptr;
+        }
+    } else {
+        _notify_enumerator = nullptr;
+    }
 }
 
 audio_manager_impl::~audio_manager_impl()
 {
+    if (_notify_enumerator) {
+        if (_endpoint_notifier) {
+            _notify_enumerator->UnregisterEndpointNotificationCallback(_endpoint_notifier);
+            _endpoint_notifier->Release();
+        }
+        _notify_enumerator->Release();
+    }
     CoUninitialize();
 }
 
@@ -137,6 +230,26 @@ void audio_manager::do_loopback_recording(std::shared_ptr<network_manager> netwo
     hr = pEndpoint->Activate(__uuidof(IAudioClient), CLSCTX_ALL, nullptr, (void**)&pAudioClient);
     exit_on_failed(hr);
 
+    // Raw mode asks the engine to hand us the stream before its processing
+    // chain (APOs: enhancements, loudness equalization, ...), trimming their
+    // latency and coloration. Loopback capture cannot leave shared mode, so
+    // a raw shared stream is as close to exclusive as the render path gets;
+    // a device that refuses just stays on the processed stream.
+    if (config.raw_mode) {
+        wil::com_ptr<IAudioClient2> pAudioClient2;
+        AudioClientProperties properties {};
+        properties.cbSize = sizeof(properties);
+        properties.bIsOffload = FALSE;
+        properties.eCategory = AudioCategory_Other;
+        properties.Options = AUDCLNT_STREAMOPTIONS_RAW;
+        if (SUCCEEDED(pAudioClient->QueryInterface(IID_PPV_ARGS(&pAudioClient2)))
+            && SUCCEEDED(pAudioClient2->SetClientProperties(&properties))) {
+            spdlog::info("raw capture stream enabled, audio engine processing bypassed");
+        } else {
+            spdlog::warn("raw capture stream unavailable on this device, using the processed stream");
+        }
+    }
+
     wil::unique_cotaskmem_ptr<WAVEFORMATEX> pMixFormat;
     pAudioClient->GetMixFormat(wil::out_param(pMixFormat));
     spdlog::info("default mix format:\n{}", *pMixFormat);
@@ -219,9 +332,47 @@ void audio_manager::do_loopback_recording(std::shared_ptr<network_manager> netwo
     hr = pAudioClient->GetDevicePeriod(nullptr, &hnsMinimumDevicePeriod);
     exit_on_failed(hr);
 
-    REFERENCE_TIME hnsRequestedDuration = REFTIMES_PER_SEC; // 1s buffer
-    hr = pAudioClient->Initialize(AUDCLNT_SHAREMODE_SHARED, AUDCLNT_STREAMFLAGS_LOOPBACK, hnsRequestedDuration, 0, pCaptureFormat.get(), nullptr);
-    exit_on_failed(hr);
+    // Event-driven capture: the engine signals an event per period instead of
+    // us polling on a timer, removing up to one device period of latency
+    constexpr DWORD stream_flags = AUDCLNT_STREAMFLAGS_LOOPBACK | AUDCLNT_STREAMFLAGS_EVENTCALLBACK;
+
+    // IAudioClient3 shared streams can run at the engine's minimum period
+    // (typically 2-3ms instead of the default 10ms). Loopback may reject
+    // small periods on some engines, so fall back to the classic Initialize.
+    uint64_t achieved_period_us = (uint64_t)hnsMinimumDevicePeriod / 10;
+    wil::com_ptr<IAudioClient3> pAudioClient3;
+    if (SUCCEEDED(pAudioClient->QueryInterface(IID_PPV_ARGS(&pAudioClient3)))) {
+        UINT32 defaultPeriodInFrames {}, fundamentalPeriodInFrames {}, minPeriodInFrames {}, maxPeriodInFrames {};
+        hr = pAudioClient3->GetSharedModeEnginePeriod(pCaptureFormat.get(), &defaultPeriodInFrames, &fundamentalPeriodInFrames, &minPeriodInFrames, &maxPeriodInFrames);
+        if (SUCCEEDED(hr)) {
+            spdlog::info("engine period frames: default {}, min {}", defaultPeriodInFrames, minPeriodInFrames);
+            hr = pAudioClient3->InitializeSharedAudioStream(stream_flags, minPeriodInFrames, pCaptureFormat.get(), nullptr);
+            if (SUCCEEDED(hr)) {
+                achieved_period_us = (uint64_t)minPeriodInFrames * 1000000 / pCaptureFormat->nSamplesPerSec;
+            }
+        }
+        if (FAILED(hr)) {
+            spdlog::info("small-period shared stream unavailable ({}), using default period", str_win_err(HRESULT_CODE(hr)));
+            pAudioClient3.reset();
+        }
+    }
+    if (!pAudioClient3) {
+        REFERENCE_TIME hnsRequestedDuration = REFTIMES_PER_SEC; // 1s buffer
+        hr = pAudioClient->Initialize(AUDCLNT_SHAREMODE_SHARED, stream_flags, hnsRequestedDuration, 0, pCaptureFormat.get(), nullptr);
+        exit_on_failed(hr);
+    }
+
+    // The stats surface reports what the device actually granted, so a box
+    // stuck on the 10ms default is visible without log digging
+    spdlog::info("achieved device period: {}us", achieved_period_us);
+    audio_share::metrics::instance().set_device_period_us(achieved_period_us);
+
+    wil::unique_handle hCaptureEvent(CreateEventW(nullptr, FALSE, FALSE, nullptr));
+    if (!hCaptureEvent) {
+        exit_on_failed(HRESULT_FROM_WIN32(GetLastError()), "CreateEventW");
+    }
+    hr = pAudioClient->SetEventHandle(hCaptureEvent.get());
+    exit_on_failed(hr, "SetEventHandle");
 
     UINT32 bufferFrameCount {};
     hr = pAudioClient->GetBufferSize(&bufferFrameCount);
@@ -236,6 +387,77 @@ void audio_manager::do_loopback_recording(std::shared_ptr<network_manager> netwo
     hr = pAudioClient->Start();
     exit_on_failed(hr);
 
+    // Secondary capture clients for the extra endpoints (a microphone is an
+    // eCapture device, so no loopback flag), each with its own event and a
+    // fifo the primary drain mixes from. A source the engine cannot run in
+    // the primary's format is skipped with a warning, never fatal.
+    struct mix_source_t {
+        wil::com_ptr<IAudioClient> client;
+        wil::com_ptr<IAudioCaptureClient> capture;
+        wil::unique_handle event;
+        std::vector<uint8_t> fifo;  // Pending bytes, capture thread only
+    };
+    std::vector<std::unique_ptr<mix_source_t>> mix_sources;
+    for (const auto& mix_id : config.mix_endpoint_ids) {
+        wil::com_ptr<IMMDevice> pMixEndpoint;
+        hr = pEnumerator->GetDevice(mbs_to_wchars(mix_id).c_str(), &pMixEndpoint);
+        if (FAILED(hr)) {
+            spdlog::warn("mix endpoint {} not found ({}), skipping", mix_id, str_win_err(HRESULT_CODE(hr)));
+            continue;
+        }
+        auto source = std::make_unique<mix_source_t>();
+        hr = pMixEndpoint->Activate(__uuidof(IAudioClient), CLSCTX_ALL, nullptr, (void**)&source->client);
+        if (FAILED(hr)) {
+            spdlog::warn("mix endpoint {} activate failed ({}), skipping", mix_id, str_win_err(HRESULT_CODE(hr)));
+            continue;
+        }
+        wil::unique_cotaskmem_ptr<WAVEFORMATEX> pClosest;
+        hr = source->client->IsFormatSupported(AUDCLNT_SHAREMODE_SHARED, pCaptureFormat.get(), wil::out_param(pClosest));
+        if (hr != S_OK) {
+            // The mixer needs byte-identical quanta; a source the engine
+            // would resample into a different layout cannot be folded in
+            spdlog::warn("mix endpoint {} cannot run the primary capture format, skipping", mix_id);
+            continue;
+        }
+        hr = source->client->Initialize(AUDCLNT_SHAREMODE_SHARED, AUDCLNT_STREAMFLAGS_EVENTCALLBACK,
+            REFTIMES_PER_SEC, 0, pCaptureFormat.get(), nullptr);
+        if (FAILED(hr)) {
+            spdlog::warn("mix endpoint {} initialize failed ({}), skipping", mix_id, str_win_err(HRESULT_CODE(hr)));
+            continue;
+        }
+        source->event.reset(CreateEventW(nullptr, FALSE, FALSE, nullptr));
+        if (!source->event
+            || FAILED(source->client->SetEventHandle(source->event.get()))
+            || FAILED(source->client->GetService(__uuidof(IAudioCaptureClient), (void**)&source->capture))
+            || FAILED(source->client->Start())) {
+            spdlog::warn("mix endpoint {} setup failed, skipping", mix_id);
+            continue;
+        }
+        spdlog::info("mixing additional endpoint: {}", mix_id);
+        mix_sources.push_back(std::move(source));
+    }
+
+    std::vector<HANDLE> wait_handles { hCaptureEvent.get() };
+    for (auto& source : mix_sources) {
+        wait_handles.push_back(source->event.get());
+    }
+    std::vector<uint8_t> mix_scratch;
+    const auto mix_encoding = [&] {
+        using mix = audio_share::sample_mixer::mix_encoding;
+        switch (_format->encoding()) {
+        case AudioFormat_Encoding_ENCODING_PCM_8BIT:
+            return mix::u8;
+        case AudioFormat_Encoding_ENCODING_PCM_16BIT:
+            return mix::s16;
+        case AudioFormat_Encoding_ENCODING_PCM_24BIT:
+            return mix::s24;
+        case AudioFormat_Encoding_ENCODING_PCM_32BIT:
+            return mix::s32;
+        default:
+            return mix::f32;
+        }
+    }();
+
     const std::chrono::milliseconds duration { hnsMinimumDevicePeriod / REFTIMES_PER_MILLISEC };
     spdlog::info("device period: {}ms", duration.count());
 
@@ -244,52 +466,91 @@ void audio_manager::do_loopback_recording(std::shared_ptr<network_manager> netwo
     int seconds {};
 #endif
 
-    using namespace std::chrono_literals;
-    asio::steady_timer timer(*network_manager->_ioc);
-    std::error_code ec;
-
-    timer.expires_at(std::chrono::steady_clock::now());
-
     do {
-        timer.expires_at(timer.expiry() + duration);
-        timer.wait(ec);
-        if (ec) {
-            break;
+        // Wake on any engine's event; time out after a second so a stalled
+        // engine still lets us observe _stopped
+        DWORD wait_result = WaitForMultipleObjects((DWORD)wait_handles.size(), wait_handles.data(), FALSE, 1000);
+        if (wait_result == WAIT_FAILED) {
+            exit_on_failed(HRESULT_FROM_WIN32(GetLastError()), "WaitForMultipleObjects");
         }
-
-        UINT32 next_packet_size = 0;
-        hr = pCaptureClient->GetNextPacketSize(&next_packet_size);
-        exit_on_failed(hr, "pCaptureClient->GetNextPacketSize");
-
-        if (next_packet_size == 0) {
+        if (wait_result == WAIT_TIMEOUT) {
             continue;
         }
 
-        BYTE* pData {};
-        UINT32 numFramesAvailable {};
-        DWORD dwFlags {};
-
-        hr = pCaptureClient->GetBuffer(&pData, &numFramesAvailable, &dwFlags, nullptr, nullptr);
-        exit_on_failed(hr, "pCaptureClient->GetBuffer");
-
-        int bytes_per_frame = pCaptureFormat->nBlockAlign;
-        size_t count = numFramesAvailable * bytes_per_frame;
+        // Drain the secondary sources into their fifos first so a quantum
+        // that is ready on both sides mixes in the same pass. A failing
+        // source just stops contributing; the primary feed is unaffected.
+        for (auto& source : mix_sources) {
+            for (;;) {
+                UINT32 mix_packet_size = 0;
+                if (FAILED(source->capture->GetNextPacketSize(&mix_packet_size)) || mix_packet_size == 0) {
+                    break;
+                }
+                BYTE* pMixData {};
+                UINT32 mixFramesAvailable {};
+                DWORD dwMixFlags {};
+                if (FAILED(source->capture->GetBuffer(&pMixData, &mixFramesAvailable, &dwMixFlags, nullptr, nullptr))) {
+                    break;
+                }
+                source->fifo.insert(source->fifo.end(), pMixData, pMixData + (size_t)mixFramesAvailable * pCaptureFormat->nBlockAlign);
+                source->capture->ReleaseBuffer(mixFramesAvailable);
+                // A source only drained when the primary wakes can run ahead;
+                // bound the backlog by dropping its oldest bytes
+                constexpr size_t MAX_FIFO = 256 * 1024;
+                if (source->fifo.size() > MAX_FIFO) {
+                    source->fifo.erase(source->fifo.begin(), source->fifo.end() - MAX_FIFO);
+                }
+            }
+        }
 
-        network_manager->broadcast_audio_data((const char*)pData, count, pCaptureFormat->nBlockAlign);
+        // One event can cover several packets, drain everything that is ready
+        for (;;) {
+            UINT32 next_packet_size = 0;
+            hr = pCaptureClient->GetNextPacketSize(&next_packet_size);
+            exit_on_failed(hr, "pCaptureClient->GetNextPacketSize");
+
+            if (next_packet_size == 0) {
+                break;
+            }
+
+            BYTE* pData {};
+            UINT32 numFramesAvailable {};
+            DWORD dwFlags {};
+
+            hr = pCaptureClient->GetBuffer(&pData, &numFramesAvailable, &dwFlags, nullptr, nullptr);
+            exit_on_failed(hr, "pCaptureClient->GetBuffer");
+
+            int bytes_per_frame = pCaptureFormat->nBlockAlign;
+            size_t count = numFramesAvailable * bytes_per_frame;
+
+            if (mix_sources.empty()) {
+                network_manager->broadcast_audio_data((const char*)pData, count, pCaptureFormat->nBlockAlign);
+            } else {
+                mix_scratch.assign(pData, pData + count);
+                for (auto& source : mix_sources) {
+                    size_t n = std::min(source->fifo.size(), count);
+                    if (n) {
+                        audio_share::sample_mixer::mix_into(mix_scratch.data(), source->fifo.data(), n, mix_encoding);
+                        source->fifo.erase(source->fifo.begin(), source->fifo.begin() + n);
+                    }
+                }
+                network_manager->broadcast_audio_data((const char*)mix_scratch.data(), count, pCaptureFormat->nBlockAlign);
+            }
 
 #ifdef DEBUG
-        frame_count += numFramesAvailable;
-        seconds = frame_count / pCaptureFormat->nSamplesPerSec;
-        // spdlog::trace("numFramesAvailable: {}, seconds: {}", numFramesAvailable, seconds);
+            frame_count += numFramesAvailable;
+            seconds = frame_count / pCaptureFormat->nSamplesPerSec;
+            // spdlog::trace("numFramesAvailable: {}, seconds: {}", numFramesAvailable, seconds);
 #endif // DEBUG
 
-        hr = pCaptureClient->ReleaseBuffer(numFramesAvailable);
-        exit_on_failed(hr, "pCaptureClient->ReleaseBuffer");
+            hr = pCaptureClient->ReleaseBuffer(numFramesAvailable);
+            exit_on_failed(hr, "pCaptureClient->ReleaseBuffer");
+        }
 
     } while (!_stopped);
 }
 
-audio_manager::endpoint_list_t audio_manager::get_endpoint_list()
+void audio_manager::refresh_endpoint_cache()
 {
     HRESULT hr {};
 
@@ -326,19 +587,14 @@ audio_manager::endpoint_list_t audio_manager::get_endpoint_list()
         endpoint_list.emplace_back(endpoint_id, name);
     }
 
-    return endpoint_list;
-}
-
-std::string audio_manager::get_default_endpoint()
-{
-    HRESULT hr {};
-
-    auto pEnumerator = wil::CoCreateInstance<MMDeviceEnumerator, IMMDeviceEnumerator>();
+    _endpoint_cache = std::move(endpoint_list);
 
+    // The default endpoint rides on the same refresh
+    _default_endpoint_cache.clear();
     wil::com_ptr<IMMDevice> pEndpoint;
     hr = pEnumerator->GetDefaultAudioEndpoint(eRender, eConsole, &pEndpoint);
     if (hr == HRESULT_FROM_WIN32(ERROR_NOT_FOUND)) {
-        return {};
+        return;
     }
     exit_on_failed(hr, "GetDefaultAudioEndpoint", __func__);
 
@@ -346,7 +602,7 @@ std::string audio_manager::get_default_endpoint()
     hr = pEndpoint->GetId(wil::out_param(pwszID));
     exit_on_failed(hr, "GetId", __func__);
 
-    return wchars_to_mbs((LPWSTR)pwszID.get());
+    _default_endpoint_cache = wchars_to_mbs((LPWSTR)pwszID.get());
 }
 
 static void set_format(std::shared_ptr<AudioFormat>& _format, PWAVEFORMATEX pFormat)
@@ -19,16 +19,28 @@
 
 #ifdef _WINDOWS
 
+#include <atomic>
 #include <string>
 
 class network_manager;
 
+struct IMMDeviceEnumerator;
+
 namespace detail {
 
+class endpoint_change_notifier;
+
 class audio_manager_impl {
 public:
     audio_manager_impl();
     ~audio_manager_impl();
+
+protected:
+    // Long-lived enumerator carrying the IMMNotificationClient registration
+    // that invalidates the endpoint cache on device hotplug
+    IMMDeviceEnumerator* _notify_enumerator = nullptr;
+    endpoint_change_notifier* _endpoint_notifier = nullptr;
+    std::atomic<bool> _endpoint_cache_dirty { true };
 };
 
 } // namespace detail